@@ -0,0 +1,618 @@
+/**
+ * Microbenchmarks for the memory manager's hot paths
+ *
+ * Each benchmark times batches of operations and reports
+ * percentiles of the time per operation, so results can be
+ * compared from version to version.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "lib/frames.h"
+#include "lib/myclock.h"
+#include "lib/ring.h"
+#include "lib/sem.h"
+#include "lib/shm.h"
+#include "lib/workload.h"
+#include "bench.h"
+
+#define OSS_PATH "./oss"
+
+// Arguments oss runs the end-to-end benchmark with
+#define OSS_ARGS "-i -n 10000 -m 2000000"
+
+static output_format format = CSV;
+static int num_samples = DEFAULT_NUM_SAMPLES;
+static int num_runs = DEFAULT_NUM_RUNS;
+
+// Only run benchmarks whose names contain this, or NULL
+static char* filter = NULL;
+
+static int num_printed = 0;
+
+// Results are added here so the compiler keeps the work
+static volatile unsigned long long sink;
+
+int main(int argc, char* argv[]) {
+  parse_command_options(argc, argv);
+
+  if (set_geometry(DEFAULT_MAX_PROCS,
+                   DEFAULT_TOTAL_MEM,
+                   DEFAULT_PAGE_SIZE,
+                   DEFAULT_PROC_MEM) == -1) {
+    fprintf(stderr, "Invalid default geometry\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (format == CSV) {
+    printf("benchmark,samples,ops_per_sample,"
+           "min_ns,p50_ns,p90_ns,p99_ns,max_ns,mean_ns\n");
+  } else {
+    printf("{\n  \"benchmarks\": [");
+  }
+
+  bench_handshake();
+  bench_page_lookup();
+  int i = 0;
+  for (; i < NUM_POLICIES; i++) {
+    bench_policy(i);
+  }
+  bench_update_clock();
+  bench_event_queue();
+  for (i = 0; i < NUM_DISTRIBUTIONS; i++) {
+    bench_workload(i);
+  }
+  bench_end_to_end();
+
+  print_footer();
+
+  return EXIT_SUCCESS;
+}
+
+static void parse_command_options(int argc, char* argv[]) {
+  int c;
+  while ((c = getopt(argc, argv, "hf:s:r:b:")) != -1) {
+    switch (c) {
+      case 'h':
+        print_help_message(argv[0]);
+        exit(EXIT_SUCCESS);
+      case 'f':
+        if (strcmp(optarg, "csv") == 0) {
+          format = CSV;
+        } else if (strcmp(optarg, "json") == 0) {
+          format = JSON;
+        } else {
+          fprintf(stderr, "Unknown output format '%s'\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 's':
+        num_samples = atoi(optarg);
+        if (num_samples <= 0) {
+          fprintf(stderr, "Invalid number of samples '%s'\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'r':
+        num_runs = atoi(optarg);
+        if (num_runs < 0) {
+          fprintf(stderr, "Invalid number of runs '%s'\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'b':
+        filter = optarg;
+        break;
+      default:
+        exit(EXIT_FAILURE);
+    }
+  }
+}
+
+/**
+ * Prints a help message.
+ * The parameters correspond to program arguments.
+ */
+static void print_help_message(char* executable_name) {
+  printf("Memory Manager Benchmarks\n\n");
+  printf("Usage: %s\n\n", executable_name);
+  printf("Arguments:\n");
+  printf(" -h  Show help.\n");
+  printf(" -f  Output format: csv or json. Defaults to csv.\n");
+  printf(" -s  Timed batches per benchmark. Defaults to %d.\n",
+         DEFAULT_NUM_SAMPLES);
+  printf(" -r  Runs of oss for the end-to-end benchmark.\n");
+  printf("     Defaults to %d. 0 skips it.\n", DEFAULT_NUM_RUNS);
+  printf(" -b  Only run benchmarks whose names contain this.\n");
+}
+
+/**
+ * Times batches of a benchmark and prints the result.
+ *
+ * One untimed batch runs first to warm caches.
+ *
+ * @param name  Name of the benchmark
+ * @param setup Run untimed before each batch, or NULL
+ * @param fn    Runs one batch
+ * @param arg   State passed to setup and fn
+ */
+static void run_benchmark(const char* name,
+                          bench_fn setup,
+                          bench_fn fn,
+                          void* arg) {
+  if (filter != NULL && strstr(name, filter) == NULL) {
+    return;
+  }
+  double* samples = malloc(sizeof(double) * num_samples);
+  if (samples == NULL) {
+    perror("Failed to allocate samples");
+    exit(EXIT_FAILURE);
+  }
+
+  if (setup != NULL) setup(arg);
+  fn(arg);
+
+  int num_ops = 0;
+  int i = 0;
+  for (; i < num_samples; i++) {
+    if (setup != NULL) setup(arg);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    num_ops = fn(arg);
+    samples[i] = get_elapsed_nanosecs(&start) / num_ops;
+  }
+
+  summarize(name, samples, num_samples, num_ops);
+  free(samples);
+}
+
+/**
+ * Prints the percentiles of a benchmark's samples.
+ *
+ * @param name           Name of the benchmark
+ * @param samples        Nanoseconds per operation of each sample
+ * @param num_samples    Number of samples
+ * @param ops_per_sample Operations timed in each sample
+ */
+static void summarize(const char* name,
+                      double* samples,
+                      int num_samples,
+                      int ops_per_sample) {
+  qsort(samples, num_samples, sizeof(double), compare_doubles);
+  double total = 0;
+  int i = 0;
+  for (; i < num_samples; i++) {
+    total += samples[i];
+  }
+  bench_result_t result;
+  result.name = name;
+  result.num_samples = num_samples;
+  result.ops_per_sample = ops_per_sample;
+  result.min = samples[0];
+  result.p50 = get_percentile(samples, num_samples, 50);
+  result.p90 = get_percentile(samples, num_samples, 90);
+  result.p99 = get_percentile(samples, num_samples, 99);
+  result.max = samples[num_samples - 1];
+  result.mean = total / num_samples;
+  print_result(&result);
+}
+
+/**
+ * @param sorted     Samples in ascending order
+ * @param num        Number of samples
+ * @param percentile 0 to 100
+ * @return           The nearest-rank percentile
+ */
+static double get_percentile(double* sorted, int num, int percentile) {
+  int rank = (num * percentile + 99) / 100;
+  return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static int compare_doubles(const void* a, const void* b) {
+  double x = *(const double*) a;
+  double y = *(const double*) b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @param start Monotonic time something started
+ * @return      Nanoseconds since then
+ */
+static double get_elapsed_nanosecs(struct timespec* start) {
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start->tv_sec) * (double) NANOSECS_PER_SEC +
+         (end.tv_nsec - start->tv_nsec);
+}
+
+static void print_result(bench_result_t* result) {
+  if (format == CSV) {
+    printf("%s,%d,%d,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f\n",
+           result->name,
+           result->num_samples,
+           result->ops_per_sample,
+           result->min,
+           result->p50,
+           result->p90,
+           result->p99,
+           result->max,
+           result->mean);
+  } else {
+    printf("%s\n    {\"name\": \"%s\", \"samples\": %d, "
+           "\"ops_per_sample\": %d, \"min_ns\": %.2f, \"p50_ns\": %.2f, "
+           "\"p90_ns\": %.2f, \"p99_ns\": %.2f, \"max_ns\": %.2f, "
+           "\"mean_ns\": %.2f}",
+           num_printed ? "," : "",
+           result->name,
+           result->num_samples,
+           result->ops_per_sample,
+           result->min,
+           result->p50,
+           result->p90,
+           result->p99,
+           result->max,
+           result->mean);
+  }
+  fflush(stdout);
+  num_printed++;
+}
+
+static void print_footer() {
+  if (format == JSON) {
+    printf("\n  ]\n}\n");
+  }
+}
+
+/**
+ * Times one request's round trip through a ring without contention:
+ * submit, ring the doorbell, take the doorbell bit, handle,
+ * complete, post the semaphore, wait on it and reap.
+ */
+static void bench_handshake() {
+  mem_rings_t* mem_rings = aligned_alloc(CACHE_LINE,
+                                         get_mem_rings_size(1));
+  if (mem_rings == NULL) {
+    perror("Failed to allocate rings");
+    exit(EXIT_FAILURE);
+  }
+  init_mem_rings(mem_rings, 1, 1, 0);
+  run_benchmark("handshake", NULL, run_handshake, mem_rings);
+  free(mem_rings);
+}
+
+static int run_handshake(void* arg) {
+  mem_rings_t* mem_rings = arg;
+  mem_ring_t* ring = get_ring(mem_rings, 0);
+  mem_op_t mem_op;
+  mem_cqe_t cqe;
+  int i = 0;
+  for (; i < OPS_PER_SAMPLE; i++) {
+    mem_op.addr = i;
+    mem_op.op = READ;
+    ring_submit(ring, &mem_op);
+    ring_doorbell(&mem_rings->doorbell, 0);
+
+    take_doorbell_word(&mem_rings->doorbell, 0, ~0ULL);
+    ring_get_submission(ring, &mem_op);
+    cqe.page_num = mem_op.addr;
+    cqe.page_fault = 0;
+    ring_complete(ring, &cqe);
+    sem_post(&ring->sem);
+
+    sem_wait(&ring->sem);
+    ring_reap_all(ring);
+  }
+  return OPS_PER_SAMPLE;
+}
+
+/**
+ * Page tables and the random references looked up in them
+ */
+typedef struct lookup_state_t {
+  page_tables_t* page_tables;
+  int pids[NUM_ADDRS];
+  unsigned long long addrs[NUM_ADDRS];
+} lookup_state_t;
+
+/**
+ * Times translating an address to its page table entry,
+ * in the default geometry's single level page tables, then
+ * in four level page tables of sparse 48-bit address spaces.
+ * Page tables hold only as many nodes as there are frames to
+ * keep loaded, so the sparse tables get a frame per reference.
+ */
+static void bench_page_lookup() {
+  bench_page_lookup_in("page_lookup");
+
+  geometry_t flat_geometry = geometry;
+  set_geometry(geometry.max_procs, NUM_ADDRS * 4096, 4096, MAX_PROC_MEM);
+  bench_page_lookup_in("page_lookup_sparse");
+  geometry = flat_geometry;
+}
+
+/**
+ * Times page table lookups of random references in the
+ * current geometry, with half of the pages touched resident.
+ *
+ * @param name The benchmark's name
+ */
+static void bench_page_lookup_in(const char* name) {
+  lookup_state_t* state = malloc(sizeof(lookup_state_t));
+  if (state == NULL) {
+    perror("Failed to allocate page tables");
+    exit(EXIT_FAILURE);
+  }
+  unsigned long long sizes[NUM_REGIONS] = { 0 };
+  sizes[PAGE_TABLES_REGION] = get_page_tables_size();
+  int arena_fd;
+  arena_t* arena = create_arena(sizes, 0, &arena_fd);
+  state->page_tables = get_region(arena, PAGE_TABLES_REGION);
+  init_page_tables(state->page_tables);
+  node_list_t free_nodes = { 0 };
+
+  unsigned int seed = 1;
+  int i = 0;
+  for (; i < NUM_ADDRS; i++) {
+    unsigned long long rand_num = rand_r(&seed);
+    rand_num = rand_num << 31 | rand_r(&seed);
+    state->pids[i] = rand_r(&seed) % geometry.max_procs;
+    state->addrs[i] = rand_num % geometry.proc_mem;
+    get_page(state->page_tables,
+             state->pids[i],
+             get_page_num(state->addrs[i]),
+             &free_nodes)->valid = rand_r(&seed) % 2;
+  }
+  run_benchmark(name, NULL, run_page_lookup, state);
+
+  detach_from_arena(arena);
+  close(arena_fd);
+  free(state);
+}
+
+static int run_page_lookup(void* arg) {
+  lookup_state_t* state = arg;
+  unsigned long long num_valid = 0;
+  int i = 0;
+  for (; i < OPS_PER_SAMPLE; i++) {
+    int j = i % NUM_ADDRS;
+    long long page_num = get_page_num(state->addrs[j]);
+    num_valid += find_page(state->page_tables,
+                           state->pids[j],
+                           page_num)->valid;
+  }
+  sink += num_valid;
+  return OPS_PER_SAMPLE;
+}
+
+/**
+ * Times a policy's fault, hit and eviction paths
+ * over every frame of the default geometry.
+ *
+ * @param type The policy
+ */
+static void bench_policy(policy_type type) {
+  frame_state_t state;
+  init_frame_bitmap(&state.frames, geometry.total_pages);
+  state.replacement = create_replacement(type,
+                                         geometry.total_pages,
+                                         geometry.max_procs *
+                                         geometry.num_proc_pages);
+  state.seed = 1;
+
+  char name[64];
+  const char* policy_name = get_policy_name(type);
+
+  snprintf(name, sizeof(name), "page_fault_%s", policy_name);
+  run_benchmark(name, empty_frames, run_page_fault, &state);
+
+  fill_frames(&state);
+  snprintf(name, sizeof(name), "page_hit_%s", policy_name);
+  run_benchmark(name, NULL, run_page_hit, &state);
+
+  snprintf(name, sizeof(name), "page_replacement_%s", policy_name);
+  run_benchmark(name, fill_frames, run_page_replacement, &state);
+
+  destroy_replacement(state.replacement);
+  destroy_frame_bitmap(&state.frames);
+}
+
+/**
+ * Faults every free frame in, then touches
+ * some of them so the policy has history.
+ */
+static int fill_frames(void* arg) {
+  frame_state_t* state = arg;
+  int num_faults = run_page_fault(state);
+  int i = 0;
+  for (; i < state->frames.num_frames; i++) {
+    replacement_access(state->replacement,
+                       rand_r(&state->seed) % state->frames.num_frames);
+  }
+  return num_faults;
+}
+
+static int empty_frames(void* arg) {
+  frame_state_t* state = arg;
+  free_frames(&state->frames, 0, state->frames.num_frames);
+  reset_replacement(state->replacement);
+  return 0;
+}
+
+/**
+ * Allocates and inserts a page into every free frame.
+ */
+static int run_page_fault(void* arg) {
+  frame_state_t* state = arg;
+  int num_keys = geometry.max_procs * geometry.num_proc_pages;
+  int num_faults = 0;
+  int frame;
+  while ((frame = allocate_frame(&state->frames,
+                                 0,
+                                 state->frames.num_frames)) != NO_FRAME) {
+    replacement_insert(state->replacement,
+                       frame,
+                       rand_r(&state->seed) % num_keys);
+    num_faults++;
+  }
+  return num_faults;
+}
+
+static int run_page_hit(void* arg) {
+  frame_state_t* state = arg;
+  int num_frames = state->frames.num_frames;
+  int i = 0;
+  for (; i < OPS_PER_SAMPLE; i++) {
+    replacement_access(state->replacement, (i * 7919) % num_frames);
+  }
+  return OPS_PER_SAMPLE;
+}
+
+/**
+ * Evicts every resident page, the way oss does
+ * when it runs page replacement.
+ */
+static int run_page_replacement(void* arg) {
+  frame_state_t* state = arg;
+  int num_evictions = 0;
+  int frame;
+  while ((frame = replacement_select_victim(state->replacement)) != NO_VICTIM) {
+    replacement_evict(state->replacement, frame);
+    free_frame(&state->frames, frame);
+    num_evictions++;
+  }
+  return num_evictions;
+}
+
+static void bench_update_clock() {
+  my_clock clock = {0};
+  run_benchmark("update_clock", NULL, run_update_clock, &clock);
+}
+
+static int run_update_clock(void* arg) {
+  my_clock* clock = arg;
+  int i = 0;
+  for (; i < OPS_PER_SAMPLE; i++) {
+    update_clock(clock, 10);
+  }
+  return OPS_PER_SAMPLE;
+}
+
+/**
+ * Times handling the earliest of one event per process
+ * and scheduling the process' next one, as oss -D does.
+ */
+static void bench_event_queue() {
+  event_bench_t state;
+  init_event_queue(&state.queue, geometry.max_procs);
+  seed_rng(&state.rng, 1);
+  int pid = 0;
+  for (; pid < geometry.max_procs; pid++) {
+    push_event(&state.queue, rng_below(&state.rng, SWAP_SEEK_NANOSECS), pid, EVENT_REFERENCE);
+  }
+  run_benchmark("event_queue", NULL, run_event_queue, &state);
+  destroy_event_queue(&state.queue);
+}
+
+static int run_event_queue(void* arg) {
+  event_bench_t* state = arg;
+  int i = 0;
+  for (; i < OPS_PER_SAMPLE; i++) {
+    // Mostly hits, with the odd fault
+    unsigned long long cost = rng_below(&state->rng, 64) == 0 ? SWAP_SEEK_NANOSECS
+                                                               : 100;
+    reschedule_first_event(&state->queue,
+                           peek_event(&state->queue)->time + cost,
+                           EVENT_REFERENCE);
+  }
+  return OPS_PER_SAMPLE;
+}
+
+/**
+ * Times making up a reference with a distribution's
+ * default parameters, in the default geometry.
+ *
+ * @param dist The distribution
+ */
+static void bench_workload(distribution dist) {
+  workload_config_t config;
+  init_workload_config(&config);
+  parse_workload_distribution(&config, get_distribution_name(dist));
+  workload_t workload;
+  init_workload(&workload, &config, 1, geometry.proc_mem, geometry.page_size);
+
+  char name[64];
+  snprintf(name, sizeof(name), "workload_%s", get_distribution_name(dist));
+  run_benchmark(name, NULL, run_workload, &workload);
+}
+
+static int run_workload(void* arg) {
+  workload_t* workload = arg;
+  unsigned long long total = 0;
+  int i = 0;
+  for (; i < OPS_PER_SAMPLE; i++) {
+    mem_op_t mem_op;
+    get_next_mem_op(workload, &mem_op);
+    total += mem_op.addr + mem_op.op;
+  }
+  sink += total;
+  return OPS_PER_SAMPLE;
+}
+
+/**
+ * Times references through oss in-process, once per run,
+ * seeding each run the same way every time.
+ */
+static void bench_end_to_end() {
+  const char* name = "end_to_end";
+  if (num_runs == 0 || (filter != NULL && strstr(name, filter) == NULL)) {
+    return;
+  }
+  double* samples = malloc(sizeof(double) * num_runs);
+  if (samples == NULL) {
+    perror("Failed to allocate samples");
+    exit(EXIT_FAILURE);
+  }
+  int i = 0;
+  for (; i < num_runs; i++) {
+    samples[i] = run_oss(i + 1);
+  }
+  summarize(name, samples, num_runs, 1);
+  free(samples);
+}
+
+/**
+ * Runs oss in-process and reads how fast it simulated references.
+ *
+ * @param seed Seed for oss' random numbers
+ * @return     Nanoseconds per reference
+ */
+static double run_oss(unsigned int seed) {
+  char command[128];
+  snprintf(command,
+           sizeof(command),
+           "%s %s -S %u 2>&1 >/dev/null",
+           OSS_PATH,
+           OSS_ARGS,
+           seed);
+  FILE* output = popen(command, "r");
+  if (output == NULL) {
+    perror("Failed to run oss");
+    exit(EXIT_FAILURE);
+  }
+  char line[256];
+  unsigned long long num_refs = 0;
+  double secs = 0;
+  while (fgets(line, sizeof(line), output) != NULL) {
+    sscanf(line, "Simulated %llu references in %lf", &num_refs, &secs);
+  }
+  if (pclose(output) != 0 || num_refs == 0) {
+    fprintf(stderr, "Failed to run %s. Build it first.\n", OSS_PATH);
+    exit(EXIT_FAILURE);
+  }
+  return secs * NANOSECS_PER_SEC / num_refs;
+}
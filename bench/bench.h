@@ -0,0 +1,102 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <time.h>
+#include "lib/eventq.h"
+#include "lib/frames.h"
+#include "lib/pagetable.h"
+#include "lib/replacement.h"
+#include "lib/rng.h"
+#include "lib/swap.h"
+#include "lib/workload.h"
+
+// Timed batches per benchmark
+#define DEFAULT_NUM_SAMPLES 200
+
+// Runs of oss for the end-to-end benchmark
+#define DEFAULT_NUM_RUNS 5
+
+// Operations timed together in each batch
+#define OPS_PER_SAMPLE 1000
+
+// Random addresses cycled through by the lookup benchmark
+#define NUM_ADDRS 4096
+
+typedef enum { CSV, JSON } output_format;
+
+/**
+ * Times one batch of a benchmark.
+ *
+ * @param arg State set up for the benchmark
+ * @return    Number of operations done
+ */
+typedef int (*bench_fn)(void* arg);
+
+/**
+ * Percentiles of a benchmark's samples, in nanoseconds per operation
+ */
+typedef struct bench_result_t {
+  const char* name;
+  int num_samples;
+  int ops_per_sample;
+  double min;
+  double p50;
+  double p90;
+  double p99;
+  double max;
+  double mean;
+} bench_result_t;
+
+/**
+ * Frames and a replacement policy, as one shard of oss holds them
+ */
+typedef struct frame_state_t {
+  frame_bitmap_t frames;
+  replacement_t* replacement;
+  unsigned int seed;
+} frame_state_t;
+
+/**
+ * An event queue and the random costs of references
+ */
+typedef struct event_bench_t {
+  event_queue_t queue;
+  rng_t rng;
+} event_bench_t;
+
+static void parse_command_options(int argc, char* argv[]);
+static void print_help_message(char* executable_name);
+static void run_benchmark(const char* name,
+                          bench_fn setup,
+                          bench_fn fn,
+                          void* arg);
+static void summarize(const char* name,
+                      double* samples,
+                      int num_samples,
+                      int ops_per_sample);
+static double get_percentile(double* sorted, int num, int percentile);
+static int compare_doubles(const void* a, const void* b);
+static double get_elapsed_nanosecs(struct timespec* start);
+static void print_result(bench_result_t* result);
+static void print_footer();
+static void bench_handshake();
+static int run_handshake(void* arg);
+static void bench_page_lookup();
+static void bench_page_lookup_in(const char* name);
+static int run_page_lookup(void* arg);
+static void bench_policy(policy_type type);
+static int fill_frames(void* arg);
+static int empty_frames(void* arg);
+static int run_page_fault(void* arg);
+static int run_page_hit(void* arg);
+static int run_page_replacement(void* arg);
+static void bench_update_clock();
+static int run_update_clock(void* arg);
+static void bench_event_queue();
+static int run_event_queue(void* arg);
+static void bench_workload(distribution dist);
+static int run_workload(void* arg);
+static void bench_end_to_end();
+static double run_oss(unsigned int seed);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef BITMAP_H_
+#define BITMAP_H_
+
+#define BITS_PER_WORD 64
+
+// Words needed to hold one bit for each of n items
+#define BITMAP_WORDS(n) (((n) + BITS_PER_WORD - 1) / BITS_PER_WORD)
+
+/**
+ * @param word  Index of a word in a bitmap
+ * @param first First item in a range
+ * @param num   Number of items in the range
+ * @return      The bits of the word that fall within the range
+ */
+static inline unsigned long long get_bitmap_range_mask(int word,
+                                                       int first,
+                                                       int num) {
+  int lo = first - word * BITS_PER_WORD;
+  int hi = first + num - word * BITS_PER_WORD;  // Exclusive
+  if (lo < 0) lo = 0;
+  if (hi > BITS_PER_WORD) hi = BITS_PER_WORD;
+  if (lo >= hi) return 0;
+  unsigned long long mask = ~0ULL << lo;
+  if (hi < BITS_PER_WORD) mask &= (1ULL << hi) - 1;
+  return mask;
+}
+
+#endif
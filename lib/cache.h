@@ -0,0 +1,8 @@
+#ifndef CACHE_H_
+#define CACHE_H_
+
+// Bytes per cache line. Data written by different
+// threads is kept this far apart to avoid false sharing.
+#define CACHE_LINE 64
+
+#endif
@@ -0,0 +1,159 @@
+#include <limits.h>
+#include "doorbell.h"
+#include "sem.h"
+
+static void wake_channel(doorbell_channel_t* channel);
+static int is_doorbell_rung(doorbell_t* doorbell, int channel);
+
+/**
+ * @param  num_procs Maximum number of processes
+ * @return           Bytes needed for a doorbell and its pending bits
+ */
+size_t get_doorbell_size(int num_procs) {
+  return sizeof(doorbell_t) +
+         sizeof(unsigned long long) * BITMAP_WORDS(num_procs);
+}
+
+/**
+ * @param doorbell     A pointer to the doorbell
+ * @param num_procs    Maximum number of processes
+ * @param num_channels Number of oss workers, up to MAX_DOORBELL_CHANNELS.
+ *                     Each gets a contiguous range of PIDs.
+ */
+void init_doorbell(doorbell_t* doorbell, int num_procs, int num_channels) {
+  doorbell->num_procs = num_procs;
+  doorbell->num_channels = num_channels;
+  doorbell->num_words = BITMAP_WORDS(num_procs);
+  int i = 0;
+  for (; i < doorbell->num_words; i++) {
+    doorbell->pending[i] = 0;
+  }
+  for (i = 0; i < MAX_DOORBELL_CHANNELS; i++) {
+    doorbell->channels[i].seq = 0;
+    doorbell->channels[i].sleeping = 0;
+  }
+}
+
+/**
+ * @param doorbell A pointer to the doorbell
+ * @param pid      Simulated PID of a process
+ * @return         The channel of the worker that serves the process
+ */
+int get_doorbell_channel(doorbell_t* doorbell, int pid) {
+  return (long long) pid * doorbell->num_channels / doorbell->num_procs;
+}
+
+/**
+ * Finds the range of PIDs a channel serves.
+ *
+ * @param doorbell  A pointer to the doorbell
+ * @param channel   Index of the channel
+ * @param first_pid Set to the first PID in the range
+ * @param num_pids  Set to the number of PIDs in the range
+ */
+void get_doorbell_channel_pids(doorbell_t* doorbell,
+                               int channel,
+                               int* first_pid,
+                               int* num_pids) {
+  long long num_procs = doorbell->num_procs;
+  int num_channels = doorbell->num_channels;
+  // Smallest pid with pid * num_channels / num_procs >= channel
+  int first = (channel * num_procs + num_channels - 1) / num_channels;
+  int next = ((channel + 1) * num_procs + num_channels - 1) / num_channels;
+  *first_pid = first;
+  *num_pids = next - first;
+}
+
+/**
+ * Marks a process as having pending requests
+ * and wakes the worker serving it if it is asleep.
+ *
+ * Called by user.
+ *
+ * @param doorbell A pointer to the doorbell
+ * @param pid      Simulated PID of the process
+ */
+void ring_doorbell(doorbell_t* doorbell, int pid) {
+  unsigned long long bit = 1ULL << (pid % BITS_PER_WORD);
+  __atomic_fetch_or(&doorbell->pending[pid / BITS_PER_WORD],
+                    bit,
+                    __ATOMIC_SEQ_CST);
+  doorbell_channel_t* channel =
+    doorbell->channels + get_doorbell_channel(doorbell, pid);
+  if (__atomic_load_n(&channel->sleeping, __ATOMIC_SEQ_CST)) {
+    wake_channel(channel);
+  }
+}
+
+/**
+ * Atomically takes and clears the pending bits of one word
+ * that are in a mask, leaving other workers' bits set.
+ *
+ * Called by oss.
+ *
+ * @param doorbell A pointer to the doorbell
+ * @param word     Index of the word
+ * @param mask     Bits of the caller's processes
+ * @return         The bits that were set
+ */
+unsigned long long take_doorbell_word(doorbell_t* doorbell,
+                                      int word,
+                                      unsigned long long mask) {
+  unsigned long long* pending = doorbell->pending + word;
+  if ((__atomic_load_n(pending, __ATOMIC_RELAXED) & mask) == 0) {
+    return 0;
+  }
+  return __atomic_fetch_and(pending, ~mask, __ATOMIC_ACQUIRE) & mask;
+}
+
+/**
+ * Sleeps until one of a channel's processes rings
+ * the doorbell, unless one already has.
+ *
+ * Called by oss. Returns early on wake_doorbell.
+ *
+ * @param doorbell A pointer to the doorbell
+ * @param channel  Index of the caller's channel
+ */
+void wait_for_doorbell(doorbell_t* doorbell, int channel) {
+  doorbell_channel_t* chan = doorbell->channels + channel;
+  unsigned int seq = __atomic_load_n(&chan->seq, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&chan->sleeping, 1, __ATOMIC_SEQ_CST);
+  if (!is_doorbell_rung(doorbell, channel)) {
+    futex_wait(&chan->seq, seq);
+  }
+  __atomic_store_n(&chan->sleeping, 0, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Wakes every oss worker.
+ * Safe to call from a signal handler.
+ *
+ * @param doorbell A pointer to the doorbell
+ */
+void wake_doorbell(doorbell_t* doorbell) {
+  int i = 0;
+  for (; i < doorbell->num_channels; i++) {
+    wake_channel(doorbell->channels + i);
+  }
+}
+
+static void wake_channel(doorbell_channel_t* channel) {
+  __atomic_add_fetch(&channel->seq, 1, __ATOMIC_SEQ_CST);
+  futex_wake(&channel->seq, 1);
+}
+
+static int is_doorbell_rung(doorbell_t* doorbell, int channel) {
+  int first_pid;
+  int num_pids;
+  get_doorbell_channel_pids(doorbell, channel, &first_pid, &num_pids);
+  int last_word = (first_pid + num_pids - 1) / BITS_PER_WORD;
+  int i = first_pid / BITS_PER_WORD;
+  for (; i <= last_word; i++) {
+    unsigned long long mask = get_bitmap_range_mask(i, first_pid, num_pids);
+    if (__atomic_load_n(&doorbell->pending[i], __ATOMIC_SEQ_CST) & mask) {
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,46 @@
+#ifndef DOORBELL_H_
+#define DOORBELL_H_
+
+#include <stddef.h>
+#include "bitmap.h"
+#include "cache.h"
+
+// Most oss worker threads a doorbell can wake separately
+#define MAX_DOORBELL_CHANNELS 64
+
+/**
+ * What one oss worker thread sleeps on
+ */
+typedef struct doorbell_channel_t {
+  unsigned int seq;       // Futex word. Bumped to wake the worker.
+  unsigned int sleeping;  // 1 while the worker is asleep
+} __attribute__((aligned(CACHE_LINE))) doorbell_channel_t;
+
+/*----------------------------------------------*
+ | One pending bit per process plus a channel   |
+ | for each oss worker to sleep on when none of |
+ | its processes' bits are set.                 |
+ *----------------------------------------------*/
+typedef struct doorbell_t {
+  int num_procs;
+  int num_channels;
+  int num_words;
+  doorbell_channel_t channels[MAX_DOORBELL_CHANNELS];
+  unsigned long long pending[];
+} doorbell_t;
+
+size_t get_doorbell_size(int num_procs);
+void init_doorbell(doorbell_t* doorbell, int num_procs, int num_channels);
+int get_doorbell_channel(doorbell_t* doorbell, int pid);
+void get_doorbell_channel_pids(doorbell_t* doorbell,
+                               int channel,
+                               int* first_pid,
+                               int* num_pids);
+void ring_doorbell(doorbell_t* doorbell, int pid);
+unsigned long long take_doorbell_word(doorbell_t* doorbell,
+                                      int word,
+                                      unsigned long long mask);
+void wait_for_doorbell(doorbell_t* doorbell, int channel);
+void wake_doorbell(doorbell_t* doorbell);
+
+#endif
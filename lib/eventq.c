@@ -0,0 +1,107 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "eventq.h"
+
+// Children per node
+#define ARITY 4
+
+static int is_before(const event_t* a, const event_t* b);
+static void sift_up(event_queue_t* queue, int i);
+static void sift_down(event_queue_t* queue, int i);
+
+/**
+ * @param queue    The queue
+ * @param capacity Most events it may hold, one per process
+ */
+void init_event_queue(event_queue_t* queue, int capacity) {
+  queue->events = malloc(sizeof(event_t) * capacity);
+  if (queue->events == NULL) {
+    perror("Failed to allocate event queue");
+    exit(EXIT_FAILURE);
+  }
+  queue->num_events = 0;
+  queue->capacity = capacity;
+}
+
+void destroy_event_queue(event_queue_t* queue) {
+  free(queue->events);
+}
+
+/**
+ * Adds an event. The queue must not be full.
+ *
+ * @param queue The queue
+ * @param time  Simulated time of the event (in nanoseconds)
+ * @param pid   Simulated PID of its process
+ * @param kind  What happens
+ */
+void push_event(event_queue_t* queue, unsigned long long time, int pid, int kind) {
+  int i = queue->num_events++;
+  queue->events[i] = (event_t) { time, pid, kind };
+  sift_up(queue, i);
+}
+
+/**
+ * Replaces the earliest event with its process' next one.
+ *
+ * @param queue The queue
+ * @param time  Simulated time of the next event (in nanoseconds),
+ *              no earlier than the one it replaces
+ * @param kind  What happens
+ */
+void reschedule_first_event(event_queue_t* queue, unsigned long long time, int kind) {
+  queue->events[0].time = time;
+  queue->events[0].kind = kind;
+  sift_down(queue, 0);
+}
+
+static int is_before(const event_t* a, const event_t* b) {
+  return a->time < b->time || (a->time == b->time && a->pid < b->pid);
+}
+
+static void sift_up(event_queue_t* queue, int i) {
+  event_t* events = queue->events;
+  event_t event = events[i];
+  while (i > 0) {
+    int parent = (i - 1) / ARITY;
+    if (!is_before(&event, &events[parent])) {
+      break;
+    }
+    events[i] = events[parent];
+    i = parent;
+  }
+  events[i] = event;
+}
+
+/**
+ * Moves an event down past any earlier children,
+ * taking the earliest child's place each level.
+ */
+static void sift_down(event_queue_t* queue, int i) {
+  event_t* events = queue->events;
+  int num_events = queue->num_events;
+  event_t event = events[i];
+  for (;;) {
+    int first_child = i * ARITY + 1;
+    if (first_child >= num_events) {
+      break;
+    }
+    int last_child = first_child + ARITY;
+    if (last_child > num_events) {
+      last_child = num_events;
+    }
+    int earliest = first_child;
+    int child = first_child + 1;
+    for (; child < last_child; child++) {
+      if (is_before(&events[child], &events[earliest])) {
+        earliest = child;
+      }
+    }
+    if (!is_before(&events[earliest], &event)) {
+      break;
+    }
+    events[i] = events[earliest];
+    i = earliest;
+  }
+  events[i] = event;
+}
@@ -0,0 +1,49 @@
+#ifndef EVENTQ_H_
+#define EVENTQ_H_
+
+/*---------------------------------------*
+ | What a simulated process does next    |
+ *---------------------------------------*/
+typedef enum {
+  EVENT_ARRIVAL,     // It is created and starts running
+  EVENT_REFERENCE,   // It makes its next memory reference
+  EVENT_FAULT_DONE,  // Its page fault completes, and it makes its next reference
+  EVENT_EXIT,        // It terminates
+  NUM_EVENT_KINDS
+} event_kind;
+
+typedef struct event_t {
+  unsigned long long time;  // Simulated (ns)
+  int pid;
+  int kind;
+} event_t;
+
+/*---------------------------------------------------*
+ | Events in order of time, then PID, so runs with   |
+ | the same events handle them in the same order.    |
+ | A 4-ary heap, which is shallower than a binary    |
+ | one, with each node's children in 64 adjacent     |
+ | bytes. Every event is followed by another for the  |
+ | same process, so the earliest is rescheduled in   |
+ | place with one sift down rather than a pop and a  |
+ | push.                                             |
+ *---------------------------------------------------*/
+typedef struct event_queue_t {
+  event_t* events;
+  int num_events;
+  int capacity;
+} event_queue_t;
+
+void init_event_queue(event_queue_t* queue, int capacity);
+void destroy_event_queue(event_queue_t* queue);
+void push_event(event_queue_t* queue, unsigned long long time, int pid, int kind);
+void reschedule_first_event(event_queue_t* queue, unsigned long long time, int kind);
+
+/**
+ * @return The earliest event. The queue must not be empty.
+ */
+static inline const event_t* peek_event(const event_queue_t* queue) {
+  return queue->events;
+}
+
+#endif
@@ -0,0 +1,181 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "frames.h"
+
+static unsigned long long get_range_mask(int word, int first, int last);
+
+/**
+ * Allocates a bitmap with every frame free.
+ * 
+ * @param frames     A pointer to the frame bitmap
+ * @param num_frames Number of frames
+ */
+void init_frame_bitmap(frame_bitmap_t* frames, int num_frames) {
+  frames->num_frames = num_frames;
+  frames->num_words = BITMAP_WORDS(num_frames);
+  frames->num_allocated = 0;
+  frames->first_free_word = 0;
+  frames->words = calloc(frames->num_words, sizeof(unsigned long long));
+  if (frames->words == NULL) {
+    perror("Failed to allocate frame bitmap");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void destroy_frame_bitmap(frame_bitmap_t* frames) {
+  free(frames->words);
+}
+
+/**
+ * Allocates the lowest free frame in a range.
+ * 
+ * @param  frames A pointer to the frame bitmap
+ * @param  first  First frame of the range
+ * @param  num    Number of frames in the range
+ * @return        The frame, or NO_FRAME if the range is fully allocated
+ */
+int allocate_frame(frame_bitmap_t* frames, int first, int num) {
+  int last = first + num - 1;
+  int word = first / BITS_PER_WORD;
+  // Words before first_free_word are full, so skip them
+  int is_from_first_free = word <= frames->first_free_word;
+  if (is_from_first_free) {
+    word = frames->first_free_word;
+  }
+  for (; word <= last / BITS_PER_WORD; word++) {
+    unsigned long long free_bits = ~frames->words[word] &
+                                   get_range_mask(word, first, last);
+    if (free_bits) {
+      frames->words[word] |= free_bits & -free_bits;
+      frames->num_allocated++;
+      return word * BITS_PER_WORD + __builtin_ctzll(free_bits);
+    }
+    if (is_from_first_free && word == frames->first_free_word &&
+        ~frames->words[word] == 0) {
+      frames->first_free_word = word + 1;
+    }
+  }
+  return NO_FRAME;
+}
+
+void free_frame(frame_bitmap_t* frames, int frame) {
+  int word = frame / BITS_PER_WORD;
+  unsigned long long bit = 1ULL << (frame % BITS_PER_WORD);
+  if (frames->words[word] & bit) {
+    frames->words[word] &= ~bit;
+    frames->num_allocated--;
+    if (word < frames->first_free_word) {
+      frames->first_free_word = word;
+    }
+  }
+}
+
+/**
+ * Frees every frame in a range.
+ * 
+ * @param frames A pointer to the frame bitmap
+ * @param first  First frame of the range
+ * @param num    Number of frames in the range
+ */
+void free_frames(frame_bitmap_t* frames, int first, int num) {
+  int last = first + num - 1;
+  int word = first / BITS_PER_WORD;
+  for (; word <= last / BITS_PER_WORD; word++) {
+    unsigned long long mask = get_range_mask(word, first, last);
+    frames->num_allocated -= __builtin_popcountll(frames->words[word] & mask);
+    frames->words[word] &= ~mask;
+  }
+  if (first / BITS_PER_WORD < frames->first_free_word) {
+    frames->first_free_word = first / BITS_PER_WORD;
+  }
+}
+
+/**
+ * Allocates every frame in a range.
+ * 
+ * @param frames A pointer to the frame bitmap
+ * @param first  First frame of the range
+ * @param num    Number of frames in the range
+ */
+void allocate_frames(frame_bitmap_t* frames, int first, int num) {
+  int last = first + num - 1;
+  int word = first / BITS_PER_WORD;
+  for (; word <= last / BITS_PER_WORD; word++) {
+    unsigned long long mask = get_range_mask(word, first, last);
+    frames->num_allocated += __builtin_popcountll(~frames->words[word] & mask);
+    frames->words[word] |= mask;
+  }
+}
+
+/**
+ * Finds the lowest run of free frames that starts at a multiple
+ * of its length, without allocating it.
+ * 
+ * @param  frames A pointer to the frame bitmap
+ * @param  num    Number of frames, a power of two up to BITS_PER_WORD
+ * @return        The run's first frame, or NO_FRAME if there is none
+ */
+int find_free_run(frame_bitmap_t* frames, int num) {
+  unsigned long long run_mask = num == BITS_PER_WORD ? ~0ULL : (1ULL << num) - 1;
+  int word = frames->first_free_word;
+  for (; word < frames->num_words; word++) {
+    unsigned long long used = frames->words[word];
+    if (used == ~0ULL) {
+      continue;
+    }
+    int offset = 0;
+    for (; offset < BITS_PER_WORD; offset += num) {
+      int first = word * BITS_PER_WORD + offset;
+      if (first + num > frames->num_frames) {
+        return NO_FRAME;
+      }
+      if ((used & (run_mask << offset)) == 0) {
+        return first;
+      }
+    }
+  }
+  return NO_FRAME;
+}
+
+int is_frame_allocated(frame_bitmap_t* frames, int frame) {
+  return (frames->words[frame / BITS_PER_WORD] >> (frame % BITS_PER_WORD)) & 1;
+}
+
+/**
+ * Counts allocated frames in a range.
+ * Answered from a running count when the range is every frame.
+ * 
+ * @param  frames A pointer to the frame bitmap
+ * @param  first  First frame of the range
+ * @param  num    Number of frames in the range
+ * @return        The number of allocated frames
+ */
+int count_allocated_frames(frame_bitmap_t* frames, int first, int num) {
+  if (first == 0 && num == frames->num_frames) {
+    return frames->num_allocated;
+  }
+  int last = first + num - 1;
+  int count = 0;
+  int word = first / BITS_PER_WORD;
+  for (; word <= last / BITS_PER_WORD; word++) {
+    count += __builtin_popcountll(frames->words[word] &
+                                  get_range_mask(word, first, last));
+  }
+  return count;
+}
+
+/**
+ * @return The bits of a word that fall within frames first through last
+ */
+static unsigned long long get_range_mask(int word, int first, int last) {
+  int lo = word * BITS_PER_WORD;
+  int hi = lo + BITS_PER_WORD - 1;
+  unsigned long long mask = ~0ULL;
+  if (first > lo) {
+    mask &= ~0ULL << (first - lo);
+  }
+  if (last < hi) {
+    mask &= ~0ULL >> (hi - last);
+  }
+  return mask;
+}
@@ -0,0 +1,31 @@
+#ifndef FRAMES_H_
+#define FRAMES_H_
+
+#include "bitmap.h"
+
+// No frame is free
+#define NO_FRAME -1
+
+/*-----------------------------------------*
+ | Word-packed map of allocated frames.    |
+ | Bit n is set when frame n is allocated. |
+ *-----------------------------------------*/
+typedef struct frame_bitmap_t {
+  unsigned long long* words;
+  int num_frames;
+  int num_words;
+  int num_allocated;
+  int first_free_word;  // Every word before this one is full
+} frame_bitmap_t;
+
+void init_frame_bitmap(frame_bitmap_t* frames, int num_frames);
+void destroy_frame_bitmap(frame_bitmap_t* frames);
+int allocate_frame(frame_bitmap_t* frames, int first, int num);
+void free_frame(frame_bitmap_t* frames, int frame);
+void free_frames(frame_bitmap_t* frames, int first, int num);
+void allocate_frames(frame_bitmap_t* frames, int first, int num);
+int find_free_run(frame_bitmap_t* frames, int num);
+int is_frame_allocated(frame_bitmap_t* frames, int frame);
+int count_allocated_frames(frame_bitmap_t* frames, int first, int num);
+
+#endif
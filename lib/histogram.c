@@ -0,0 +1,115 @@
+#include <string.h>
+#include "histogram.h"
+
+static int get_bucket(unsigned long long value);
+static unsigned long long get_bucket_max(int bucket);
+
+void reset_histogram(histogram_t* hist) {
+  memset(hist, 0, sizeof(histogram_t));
+}
+
+/**
+ * Counts a value.
+ *
+ * Single writer, so plain loads and stores suffice.
+ * They are atomic so readers never see a torn word.
+ *
+ * @param hist  A pointer to the histogram
+ * @param value The value
+ */
+void record_histogram(histogram_t* hist, unsigned long long value) {
+  unsigned int* bucket = hist->buckets + get_bucket(value);
+  __atomic_store_n(bucket,
+                   __atomic_load_n(bucket, __ATOMIC_RELAXED) + 1,
+                   __ATOMIC_RELAXED);
+  __atomic_store_n(&hist->count, hist->count + 1, __ATOMIC_RELAXED);
+  if (value > hist->max) {
+    __atomic_store_n(&hist->max, value, __ATOMIC_RELAXED);
+  }
+}
+
+/**
+ * Adds every value of one histogram to another.
+ * Safe for several threads to merge into the same histogram at once.
+ *
+ * @param dest Histogram to add to
+ * @param src  Histogram to add
+ */
+void merge_histogram(histogram_t* dest, histogram_t* src) {
+  int i = 0;
+  for (; i < HIST_NUM_BUCKETS; i++) {
+    unsigned int count = __atomic_load_n(src->buckets + i, __ATOMIC_RELAXED);
+    if (count) {
+      __atomic_add_fetch(dest->buckets + i, count, __ATOMIC_RELAXED);
+    }
+  }
+  __atomic_add_fetch(&dest->count,
+                     __atomic_load_n(&src->count, __ATOMIC_RELAXED),
+                     __ATOMIC_RELAXED);
+  unsigned long long max = __atomic_load_n(&src->max, __ATOMIC_RELAXED);
+  unsigned long long dest_max = __atomic_load_n(&dest->max, __ATOMIC_RELAXED);
+  while (max > dest_max &&
+         !__atomic_compare_exchange_n(&dest->max, &dest_max, max, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+}
+
+/**
+ * @param hist       A pointer to the histogram
+ * @param percentile 0 to 100, such as 99.9
+ * @return           The largest value that could be in the bucket
+ *                   holding the percentile, but never more than the
+ *                   max. 0 if the histogram is empty.
+ */
+unsigned long long get_histogram_percentile(histogram_t* hist, double percentile) {
+  unsigned long long count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+  unsigned long long max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+  if (count == 0) {
+    return 0;
+  }
+  unsigned long long rank = (unsigned long long) (percentile / 100 * count + 0.5);
+  if (rank == 0) rank = 1;
+  unsigned long long seen = 0;
+  int i = 0;
+  for (; i < HIST_NUM_BUCKETS; i++) {
+    seen += __atomic_load_n(hist->buckets + i, __ATOMIC_RELAXED);
+    if (seen >= rank && i < HIST_NUM_BUCKETS - 1) {
+      unsigned long long bucket_max = get_bucket_max(i);
+      return bucket_max < max ? bucket_max : max;
+    }
+  }
+  return max;
+}
+
+/**
+ * Values below HIST_SUB_BUCKETS get a bucket each. Every power of
+ * two above that is split into HIST_SUB_BUCKETS linear buckets.
+ *
+ * @param value A value
+ * @return      Index of the value's bucket
+ */
+static int get_bucket(unsigned long long value) {
+  if (value < HIST_SUB_BUCKETS) {
+    return value;
+  }
+  int magnitude = 63 - __builtin_clzll(value);
+  if (magnitude > HIST_MAX_MAGNITUDE) {
+    return HIST_NUM_BUCKETS - 1;
+  }
+  int sub_bucket = (value >> (magnitude - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1);
+  return ((magnitude - HIST_SUB_BITS + 1) << HIST_SUB_BITS) + sub_bucket;
+}
+
+/**
+ * @param bucket Index of a bucket
+ * @return       The largest value the bucket holds
+ */
+static unsigned long long get_bucket_max(int bucket) {
+  if (bucket < HIST_SUB_BUCKETS) {
+    return bucket;
+  }
+  int magnitude = (bucket >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+  int sub_bucket = bucket & (HIST_SUB_BUCKETS - 1);
+  int shift = magnitude - HIST_SUB_BITS;
+  return ((unsigned long long) (HIST_SUB_BUCKETS + sub_bucket + 1) << shift) - 1;
+}
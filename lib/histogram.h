@@ -0,0 +1,35 @@
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+// Linear sub-buckets per power of two. Each bucket
+// is at most 1/8 as wide as the values it holds.
+#define HIST_SUB_BITS 3
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+
+// Largest power of two tracked. Bigger values
+// share the top bucket but still count toward max.
+#define HIST_MAX_MAGNITUDE 40
+
+#define HIST_NUM_BUCKETS \
+  ((HIST_MAX_MAGNITUDE - HIST_SUB_BITS + 2) << HIST_SUB_BITS)
+
+/*-------------------------------------------------*
+ | Log-bucketed histogram of non-negative values,  |
+ | such as latencies in nanoseconds.               |
+ |                                                 |
+ | Recording is O(1) and takes no locks. Only one  |
+ | thread may record into a histogram at a time,   |
+ | but any thread may read or merge it.            |
+ *-------------------------------------------------*/
+typedef struct histogram_t {
+  unsigned long long count;
+  unsigned long long max;
+  unsigned int buckets[HIST_NUM_BUCKETS];
+} histogram_t;
+
+void reset_histogram(histogram_t* hist);
+void record_histogram(histogram_t* hist, unsigned long long value);
+void merge_histogram(histogram_t* dest, histogram_t* src);
+unsigned long long get_histogram_percentile(histogram_t* hist, double percentile);
+
+#endif
@@ -0,0 +1,387 @@
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cache.h"
+#include "logger.h"
+#include "sem.h"
+
+// Longest the writer sleeps before looking for records again
+#define WRITER_SLEEP_NANOSECS 10000000
+
+// Longest a blocked thread sleeps before looking for space again
+#define BLOCKED_SLEEP_NANOSECS 1000000
+
+// Records formatted by log_printf on the stack before being copied
+#define MAX_INLINE_TEXT 256
+
+typedef enum { RECORD_EMPTY, RECORD_PADDING, RECORD_READY } record_state;
+
+/**
+ * Precedes every record in the buffer.
+ * Records are a multiple of its size, so padding always fits one.
+ */
+typedef struct log_header_t {
+  unsigned int size;     // Bytes in the record, header included
+  unsigned int state;    // RECORD_EMPTY until the record is committed
+  log_format_fn format;
+} log_header_t;
+
+/**
+ * A record logged by log_ints
+ */
+typedef struct ints_record_t {
+  const char* format;
+  int args[3];
+} ints_record_t;
+
+/*----------------------------------------------------*
+ | A multi-producer, single-consumer ring of records. |
+ |                                                    |
+ | Producers claim space by moving head forward with  |
+ | a compare and swap, fill it in and mark it ready.  |
+ | The writer consumes ready records at tail, zeroes  |
+ | them and moves tail forward.                       |
+ *----------------------------------------------------*/
+struct logger_t {
+  unsigned long long head __attribute__((aligned(CACHE_LINE)));
+  unsigned long long tail __attribute__((aligned(CACHE_LINE)));
+  unsigned int data_seq __attribute__((aligned(CACHE_LINE)));  // Writer sleeps on
+  unsigned int writer_sleeping;
+  unsigned int space_seq;    // Blocked producers sleep on
+  unsigned int num_blocked;
+  unsigned long long num_drops;
+  int should_stop;
+  log_policy policy;
+  size_t size;               // Power of two
+  char* buffer;
+  FILE* file;
+  pthread_t writer;
+};
+
+static int wait_for_space(logger_t* logger);
+static void drop_record(logger_t* logger);
+static void* run_writer(void* arg);
+static int drain_records(logger_t* logger);
+static void sleep_writer(logger_t* logger);
+static void wake_writer(logger_t* logger);
+static log_header_t* get_header(logger_t* logger, unsigned long long pos);
+static void format_ints(FILE* out, const void* data);
+static void format_text(FILE* out, const void* data);
+
+/**
+ * Creates a log file and starts its writer thread.
+ *
+ * @param  path        Path of the log file
+ * @param  buffer_size Bytes of records to buffer. A power of two.
+ * @param  policy      Whether a full buffer blocks or drops records
+ * @return             The log, or NULL on error
+ */
+logger_t* open_logger(const char* path, size_t buffer_size, log_policy policy) {
+  logger_t* logger;
+  if (posix_memalign((void**) &logger, CACHE_LINE, sizeof(logger_t)) != 0) {
+    fprintf(stderr, "Failed to allocate log\n");
+    return NULL;
+  }
+  memset(logger, 0, sizeof(logger_t));
+  logger->policy = policy;
+  logger->size = buffer_size;
+  logger->buffer = calloc(1, buffer_size);
+  if (logger->buffer == NULL) {
+    perror("Failed to allocate log buffer");
+    free(logger);
+    return NULL;
+  }
+  logger->file = fopen(path, "w");
+  if (logger->file == NULL) {
+    perror("Failed to open log file");
+    free(logger->buffer);
+    free(logger);
+    return NULL;
+  }
+  setvbuf(logger->file, NULL, _IOFBF, buffer_size);
+
+  // Signals go to the threads that expect them, never the writer
+  sigset_t all_signals;
+  sigset_t old_mask;
+  sigfillset(&all_signals);
+  pthread_sigmask(SIG_SETMASK, &all_signals, &old_mask);
+  int error = pthread_create(&logger->writer, NULL, run_writer, logger);
+  pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+  if (error) {
+    errno = error;
+    perror("Failed to start log writer");
+    fclose(logger->file);
+    free(logger->buffer);
+    free(logger);
+    return NULL;
+  }
+  return logger;
+}
+
+/**
+ * Writes every record still buffered, then closes the log.
+ * No other thread may log once this is called.
+ *
+ * @param logger The log
+ */
+void close_logger(logger_t* logger) {
+  __atomic_store_n(&logger->should_stop, 1, __ATOMIC_RELEASE);
+  wake_writer(logger);
+  pthread_join(logger->writer, NULL);
+  if (fclose(logger->file) == EOF) {
+    perror("Failed to close log file");
+  }
+  free(logger->buffer);
+  free(logger);
+}
+
+/**
+ * Claims space for a record in the buffer.
+ * The caller fills in the data, then commits it.
+ *
+ * @param logger The log
+ * @param format Called with the data to write it out
+ * @param size   Bytes of data
+ * @return       Where to put the data, or NULL if the record was dropped
+ */
+void* reserve_log_record(logger_t* logger, log_format_fn format, size_t size) {
+  size_t record_size = sizeof(log_header_t) + size;
+  record_size = (record_size + sizeof(log_header_t) - 1) &
+                ~(sizeof(log_header_t) - 1);
+  if (record_size > logger->size / 4) {
+    drop_record(logger);  // Would never fit alongside padding
+    return NULL;
+  }
+
+  unsigned long long head = __atomic_load_n(&logger->head, __ATOMIC_RELAXED);
+  size_t padding;
+  for (;;) {
+    size_t offset = head & (logger->size - 1);
+    padding = offset + record_size > logger->size ? logger->size - offset : 0;
+    unsigned long long tail = __atomic_load_n(&logger->tail, __ATOMIC_ACQUIRE);
+    if (tail > head) {  // head is stale
+      head = __atomic_load_n(&logger->head, __ATOMIC_RELAXED);
+      continue;
+    }
+    if (head + padding + record_size - tail > logger->size) {
+      if (!wait_for_space(logger)) {
+        return NULL;
+      }
+      head = __atomic_load_n(&logger->head, __ATOMIC_RELAXED);
+      continue;
+    }
+    if (__atomic_compare_exchange_n(&logger->head,
+                                    &head,
+                                    head + padding + record_size,
+                                    1,
+                                    __ATOMIC_RELAXED,
+                                    __ATOMIC_RELAXED)) {
+      break;
+    }
+  }
+
+  if (padding) {  // Records never wrap around the end of the buffer
+    log_header_t* pad = get_header(logger, head);
+    pad->size = padding;
+    __atomic_store_n(&pad->state, RECORD_PADDING, __ATOMIC_RELEASE);
+  }
+  log_header_t* header = get_header(logger, head + padding);
+  header->size = record_size;
+  header->format = format;
+  return header + 1;
+}
+
+/**
+ * Hands a filled in record to the writer.
+ *
+ * @param logger The log
+ * @param data   What reserve_log_record returned
+ */
+void commit_log_record(logger_t* logger, void* data) {
+  log_header_t* header = (log_header_t*) data - 1;
+  __atomic_store_n(&header->state, RECORD_READY, __ATOMIC_RELEASE);
+
+  // The writer wakes up by itself unless the buffer is filling up
+  if (__atomic_load_n(&logger->writer_sleeping, __ATOMIC_RELAXED)) {
+    unsigned long long head = __atomic_load_n(&logger->head, __ATOMIC_RELAXED);
+    unsigned long long tail = __atomic_load_n(&logger->tail, __ATOMIC_RELAXED);
+    if (head - tail >= logger->size / 2) {
+      wake_writer(logger);
+    }
+  }
+}
+
+/**
+ * Logs a message whose arguments are all ints.
+ * Formatting is left to the writer, so this only copies four words.
+ *
+ * @param logger The log
+ * @param format A printf format string that lives for the whole run,
+ *               with at most three int conversions
+ * @param arg1   First argument, if any
+ * @param arg2   Second argument, if any
+ * @param arg3   Third argument, if any
+ */
+void log_ints(logger_t* logger, const char* format, int arg1, int arg2, int arg3) {
+  ints_record_t* record = reserve_log_record(logger,
+                                             format_ints,
+                                             sizeof(ints_record_t));
+  if (record == NULL) {
+    return;
+  }
+  record->format = format;
+  record->args[0] = arg1;
+  record->args[1] = arg2;
+  record->args[2] = arg3;
+  commit_log_record(logger, record);
+}
+
+/**
+ * Logs a message formatted by the caller.
+ * Meant for messages off the request path.
+ *
+ * @param logger The log
+ * @param format A printf format string
+ */
+void log_printf(logger_t* logger, const char* format, ...) {
+  char text[MAX_INLINE_TEXT];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  if (length < 0) {
+    return;
+  }
+
+  char* record = reserve_log_record(logger, format_text, length + 1);
+  if (record == NULL) {
+    return;
+  }
+  if (length < MAX_INLINE_TEXT) {
+    memcpy(record, text, length + 1);
+  } else {
+    va_start(args, format);
+    vsnprintf(record, length + 1, format, args);
+    va_end(args);
+  }
+  commit_log_record(logger, record);
+}
+
+/**
+ * @param logger The log
+ * @return       Number of records dropped because the buffer was full
+ */
+unsigned long long get_log_drops(logger_t* logger) {
+  return __atomic_load_n(&logger->num_drops, __ATOMIC_RELAXED);
+}
+
+/**
+ * Waits for the writer to free some space,
+ * unless full buffers drop records.
+ *
+ * @return 1 to try again. 0 if the record was dropped.
+ */
+static int wait_for_space(logger_t* logger) {
+  if (logger->policy == LOG_DROP) {
+    drop_record(logger);
+    return 0;
+  }
+  unsigned int seq = __atomic_load_n(&logger->space_seq, __ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&logger->num_blocked, 1, __ATOMIC_SEQ_CST);
+  wake_writer(logger);
+  futex_wait_timeout(&logger->space_seq, seq, BLOCKED_SLEEP_NANOSECS);
+  __atomic_sub_fetch(&logger->num_blocked, 1, __ATOMIC_SEQ_CST);
+  return 1;
+}
+
+static void drop_record(logger_t* logger) {
+  __atomic_add_fetch(&logger->num_drops, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Writes records until the log is closed.
+ * Only flushes the file when there is nothing left to write.
+ */
+static void* run_writer(void* arg) {
+  logger_t* logger = arg;
+  for (;;) {
+    int should_stop = __atomic_load_n(&logger->should_stop, __ATOMIC_ACQUIRE);
+    if (drain_records(logger)) {
+      continue;
+    }
+    fflush(logger->file);
+    if (should_stop) {
+      break;
+    }
+    sleep_writer(logger);
+  }
+  return NULL;
+}
+
+/**
+ * Writes out every record that is ready, in order,
+ * stopping at the first one still being filled in.
+ *
+ * @return The number of records consumed
+ */
+static int drain_records(logger_t* logger) {
+  int num_drained = 0;
+  unsigned long long tail = logger->tail;  // Only the writer moves it
+  for (;;) {
+    log_header_t* header = get_header(logger, tail);
+    unsigned int state = __atomic_load_n(&header->state, __ATOMIC_ACQUIRE);
+    if (state == RECORD_EMPTY) {
+      break;
+    }
+    unsigned int size = header->size;
+    if (state == RECORD_READY) {
+      header->format(logger->file, header + 1);
+    }
+    memset(header, 0, size);
+    tail += size;
+    __atomic_store_n(&logger->tail, tail, __ATOMIC_RELEASE);
+    num_drained++;
+  }
+  if (num_drained && __atomic_load_n(&logger->num_blocked, __ATOMIC_SEQ_CST)) {
+    __atomic_add_fetch(&logger->space_seq, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&logger->space_seq, INT_MAX);
+  }
+  return num_drained;
+}
+
+static void sleep_writer(logger_t* logger) {
+  unsigned int seq = __atomic_load_n(&logger->data_seq, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&logger->writer_sleeping, 1, __ATOMIC_SEQ_CST);
+  log_header_t* header = get_header(logger, logger->tail);
+  if (__atomic_load_n(&header->state, __ATOMIC_SEQ_CST) == RECORD_EMPTY &&
+      !__atomic_load_n(&logger->should_stop, __ATOMIC_SEQ_CST)) {
+    futex_wait_timeout(&logger->data_seq, seq, WRITER_SLEEP_NANOSECS);
+  }
+  __atomic_store_n(&logger->writer_sleeping, 0, __ATOMIC_SEQ_CST);
+}
+
+static void wake_writer(logger_t* logger) {
+  __atomic_add_fetch(&logger->data_seq, 1, __ATOMIC_SEQ_CST);
+  futex_wake(&logger->data_seq, 1);
+}
+
+/**
+ * @param pos Position in the stream of bytes ever logged
+ * @return    The header at that position in the buffer
+ */
+static log_header_t* get_header(logger_t* logger, unsigned long long pos) {
+  return (log_header_t*) (logger->buffer + (pos & (logger->size - 1)));
+}
+
+static void format_ints(FILE* out, const void* data) {
+  const ints_record_t* record = data;
+  fprintf(out, record->format, record->args[0], record->args[1], record->args[2]);
+}
+
+static void format_text(FILE* out, const void* data) {
+  fputs(data, out);
+}
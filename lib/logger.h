@@ -0,0 +1,40 @@
+#ifndef LOGGER_H_
+#define LOGGER_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Bytes of records a log buffers in memory by default
+#define DEFAULT_LOG_BUFFER_SIZE (1 << 20)
+
+/**
+ * What a thread does when its record does not fit in the buffer
+ */
+typedef enum { LOG_BLOCK, LOG_DROP } log_policy;
+
+/**
+ * Writes a record's data to the log file.
+ * Called on the writer thread.
+ *
+ * @param out  The log file
+ * @param data The data the record was logged with
+ */
+typedef void (*log_format_fn)(FILE* out, const void* data);
+
+/*---------------------------------------------*
+ | A log that any thread appends records to    |
+ | without locks or I/O. A background thread   |
+ | formats them and writes them in big blocks. |
+ *---------------------------------------------*/
+typedef struct logger_t logger_t;
+
+logger_t* open_logger(const char* path, size_t buffer_size, log_policy policy);
+void close_logger(logger_t* logger);
+void* reserve_log_record(logger_t* logger, log_format_fn format, size_t size);
+void commit_log_record(logger_t* logger, void* data);
+void log_ints(logger_t* logger, const char* format, int arg1, int arg2, int arg3);
+void log_printf(logger_t* logger, const char* format, ...)
+  __attribute__((format(printf, 2, 3)));
+unsigned long long get_log_drops(logger_t* logger);
+
+#endif
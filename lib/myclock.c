@@ -1,29 +1,67 @@
+#include <time.h>
 #include "myclock.h"
 
 /**
- * Adds a second to the clock when nanoseconds
- * exceed the amount of nanoseconds per second.
- * @param  myclock A pointer to a clock
- * @return         1 if the clock was rounded. 0 otherwise.
+ * Advances the clock with one atomic add, which
+ * any number of threads and processes may do at once.
+ * 
+ * @param  myclock  A pointer to a clock.
+ * @param  nanosecs The amount of nanoseconds to increment by.
+ * @return          The clock's time just after this add.
+ */
+unsigned long long update_clock(my_clock* myclock, unsigned long long nanosecs) {
+  return __atomic_add_fetch(&myclock->nanosecs, nanosecs, __ATOMIC_RELAXED);
+}
+
+/**
+ * @param  now      The clock's time after an add, from update_clock.
+ * @param  nanosecs The amount that was added.
+ * @return          1 if the add took the clock into a new second.
+ *                  0 otherwise.
  */
-int round_clock(my_clock* myclock) {
-  if (myclock->nanosecs < NANOSECS_PER_SEC) {
-    return 0;
-  }
-  myclock->secs++;
-  myclock->nanosecs -= NANOSECS_PER_SEC;
-  return 1;
+int has_crossed_second(unsigned long long now, unsigned long long nanosecs) {
+  return get_secs(now) != get_secs(now - nanosecs);
 }
 
 /**
- * Updates the clock with an amount of nanoseconds.
- * Rounds the clock if needed.
+ * @param  myclock A pointer to a clock.
+ * @return         The clock's time in nanoseconds.
+ */
+unsigned long long get_clock_nanosecs(my_clock* myclock) {
+  return __atomic_load_n(&myclock->nanosecs, __ATOMIC_RELAXED);
+}
+
+/**
+ * Sets the clock to a time in nanoseconds.
  * 
- * @param  myclock  A pointer to a clock.
- * @param  nanosecs The amount of nanoseconds to increment by.
- * @return          1 if the clock was rounded. 0 otherwise.
+ * @param myclock  A pointer to a clock.
+ * @param nanosecs The time in nanoseconds.
+ */
+void set_clock_nanosecs(my_clock* myclock, unsigned long long nanosecs) {
+  __atomic_store_n(&myclock->nanosecs, nanosecs, __ATOMIC_RELAXED);
+}
+
+/**
+ * @param  nanosecs A time in nanoseconds.
+ * @return          Its whole seconds.
+ */
+unsigned int get_secs(unsigned long long nanosecs) {
+  return nanosecs / NANOSECS_PER_SEC;
+}
+
+/**
+ * @param  nanosecs A time in nanoseconds.
+ * @return          Its nanoseconds past the whole second.
+ */
+unsigned int get_subsec_nanosecs(unsigned long long nanosecs) {
+  return nanosecs % NANOSECS_PER_SEC;
+}
+
+/**
+ * @return Monotonic wall clock time in nanoseconds
  */
-int update_clock(my_clock* myclock, unsigned int nanosecs) {
-  myclock->nanosecs += nanosecs;
-  return round_clock(myclock);
+unsigned long long get_real_nanosecs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long long) now.tv_sec * NANOSECS_PER_SEC + now.tv_nsec;
 }
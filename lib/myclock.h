@@ -7,15 +7,23 @@
 // 1 * 10^6 nanoseconds
 #define NANOSECS_PER_MILLISEC 1000000  
 
-/*--------------------------*
- | A simple simulated clock |
- *--------------------------*/
+/*-----------------------------------------------*
+ | A simple simulated clock. It is one count of  |
+ | nanoseconds, read and advanced atomically, so |
+ | oss' workers and user processes share it      |
+ | without a lock. Seconds are split out of it   |
+ | only to display a time.                       |
+ *-----------------------------------------------*/
 typedef struct my_clock {
-  unsigned int secs;      // Amount of time in seconds
-  unsigned int nanosecs;  // Amount of time in nanoseconds
+  unsigned long long nanosecs;
 } my_clock;
 
-int round_clock(my_clock* myclock);
-int update_clock(my_clock* myclock, unsigned int nanosecs);
+unsigned long long update_clock(my_clock* myclock, unsigned long long nanosecs);
+int has_crossed_second(unsigned long long now, unsigned long long nanosecs);
+unsigned long long get_clock_nanosecs(my_clock* myclock);
+void set_clock_nanosecs(my_clock* myclock, unsigned long long nanosecs);
+unsigned int get_secs(unsigned long long nanosecs);
+unsigned int get_subsec_nanosecs(unsigned long long nanosecs);
+unsigned long long get_real_nanosecs();
 
 #endif
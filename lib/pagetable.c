@@ -1,54 +1,155 @@
 #include <stdlib.h>
 #include <stdio.h>
-#include <sys/shm.h>
-#include <sys/stat.h>
+#include <string.h>
+#include "cache.h"
 #include "pagetable.h"
 
+geometry_t geometry;
+
+static void setup_page_division(unsigned int page_size);
+static int get_page_num_bits();
+static unsigned long long get_nodes_per_table();
+static size_t get_node_offset();
+static void* get_node(page_tables_t* page_tables, unsigned int node);
+static unsigned int* get_node_count(page_tables_t* page_tables, unsigned int node);
+static unsigned int get_leaf(page_tables_t* page_tables, page* pg);
+static void free_node(page_tables_t* page_tables,
+                      unsigned int node,
+                      node_list_t* free_nodes);
+static unsigned int get_level_index(long long page_num, int level);
+static unsigned int allocate_node(page_tables_t* page_tables,
+                                  node_list_t* free_nodes,
+                                  int level);
+static void visit_leaves(page_tables_t* page_tables,
+                         unsigned int node,
+                         int level,
+                         long long first_page,
+                         leaf_fn fn,
+                         void* arg);
+static void free_nodes_below(page_tables_t* page_tables,
+                             unsigned int node,
+                             int level,
+                             node_list_t* free_nodes);
+
 /**
- * Allocates shared memory for page tables.
- * 
- * @return The shared memory segment ID
+ * Sets the memory geometry. Must be called before
+ * anything else in this file. Page tables get as
+ * few levels of at most 9 bits as cover the pages,
+ * up to MAX_PAGE_TABLE_LEVELS.
+ *
+ * @param  max_procs Maximum number of processes
+ * @param  total_mem Total system memory (in bytes)
+ * @param  page_size Page size (in bytes)
+ * @param  proc_mem  Amount of memory per process (in bytes)
+ * @return           0 on success. -1 if the geometry is invalid.
  */
-int get_page_tables() {
-  size_t size = sizeof(page) * TOTAL_PAGES;
-  int id = shmget(IPC_PRIVATE, size,
-    IPC_CREAT | IPC_EXCL | S_IRUSR | S_IWUSR);
+int set_geometry(int max_procs,
+                 unsigned int total_mem,
+                 unsigned int page_size,
+                 unsigned long long proc_mem) {
+  if (max_procs < 1 || page_size < 1 ||
+      total_mem < page_size || proc_mem < page_size ||
+      proc_mem % page_size != 0 || proc_mem > MAX_PROC_MEM) {
+    return -1;
+  }
+  geometry.max_procs = max_procs;
+  geometry.total_mem = total_mem;
+  geometry.page_size = page_size;
+  geometry.proc_mem = proc_mem;
+  geometry.total_pages = total_mem / page_size;
+  geometry.num_proc_pages = proc_mem / page_size;
+  setup_page_division(page_size);
 
-  if (id == -1) {
-    perror("Failed to get shared memory for page tables");
-    exit(EXIT_FAILURE);
+  int bits = get_page_num_bits();
+  int num_levels = (bits + 8) / 9;
+  if (num_levels > MAX_PAGE_TABLE_LEVELS) {
+    num_levels = MAX_PAGE_TABLE_LEVELS;
+  }
+  int level_bits[MAX_PAGE_TABLE_LEVELS];
+  int i = 0;
+  for (; i < num_levels; i++) {
+    level_bits[i] = bits / num_levels + (i < bits % num_levels);
   }
-  return id;
+  return set_page_table_levels(level_bits, num_levels);
 }
 
 /**
- * Attaches to page tables in shared memory.
- * 
- * @return A pointer to page tables in shared memory.
+ * Sets how many bits of the page number each
+ * level of the page tables indexes, root first.
+ *
+ * @param  level_bits Bits per level
+ * @param  num_levels Number of levels
+ * @return            0 on success. -1 if there are too many
+ *                    levels, a level is too wide, or the levels
+ *                    do not cover every page number.
  */
-page* attach_to_page_tables(int id) {
-  void* page_tables = shmat(id, NULL, 0);
+int set_page_table_levels(const int* level_bits, int num_levels) {
+  if (num_levels < 1 || num_levels > MAX_PAGE_TABLE_LEVELS) {
+    return -1;
+  }
+  int total_bits = 0;
+  int i = 0;
+  for (; i < num_levels; i++) {
+    if (level_bits[i] < 1 || level_bits[i] > MAX_LEVEL_BITS) {
+      return -1;
+    }
+    total_bits += level_bits[i];
+  }
+  if (total_bits < get_page_num_bits()) {
+    return -1;
+  }
 
-  if (*((int*) page_tables) == -1) {
-    perror("Failed to attach to page tables in shared memory");
-    exit(EXIT_FAILURE);
+  geometry.num_levels = num_levels;
+  geometry.node_size = 0;
+  int shift = 0;
+  for (i = num_levels - 1; i >= 0; i--) {
+    geometry.level_bits[i] = level_bits[i];
+    geometry.level_shift[i] = shift;
+    shift += level_bits[i];
+    size_t entry_size = i == num_levels - 1 ? sizeof(page) : sizeof(unsigned int);
+    size_t node_size = entry_size << level_bits[i];
+    if (node_size > geometry.node_size) {
+      geometry.node_size = node_size;
+    }
   }
 
-  return (page*) page_tables;
+  // Enough nodes for every page of every process, or for the path to
+  // every frame's page and one more page per process, since only
+  // loaded pages and pages being loaded keep their nodes
+  unsigned long long max_nodes = geometry.max_procs * get_nodes_per_table();
+  unsigned long long max_loaded =
+    (unsigned long long) (geometry.total_pages + geometry.max_procs) * num_levels;
+  if (max_nodes > max_loaded) {
+    max_nodes = max_loaded;
+  }
+  max_nodes++;
+  unsigned long long max_fit = MAX_PAGE_TABLES_SIZE / geometry.node_size;
+  if (max_nodes > max_fit) {
+    max_nodes = max_fit;
+  }
+  geometry.max_nodes = max_nodes;
+  return 0;
 }
 
 /**
- * Detaches from page tables in shared memory
- * 
- * @param A pointer to page tables in shared memory
- * @return On success, 0. On error -1.
+ * Only the nodes that are used take up memory.
+ *
+ * @return Size of the shared memory for page tables (in bytes)
  */
-int detach_from_page_tables(page* page_tables) {
-  int success = shmdt(page_tables);
-  if (success == -1) {
-    perror("FaileROCd to detach from page tables");
-  }
-  return success;
+unsigned long long get_page_tables_size() {
+  return get_node_offset() + geometry.node_size * geometry.max_nodes;
+}
+
+/**
+ * Gives every process an empty page table.
+ */
+void init_page_tables(page_tables_t* page_tables) {
+  page_tables->next_node = 1;
+  page_tables->max_nodes = geometry.max_nodes;
+  page_tables->counts_offset = sizeof(page_tables_t) +
+                               sizeof(unsigned int) * geometry.max_procs;
+  page_tables->node_offset = get_node_offset();
+  memset(page_tables->roots, 0, sizeof(unsigned int) * geometry.max_procs);
 }
 
 /**
@@ -61,14 +162,431 @@ int detach_from_page_tables(page* page_tables) {
  * @param  mem_addr Memory address
  * @return          The page number the address belongs to
  */
-int get_page_num(unsigned int mem_addr) {
-  if (mem_addr > PROC_MEM) {
+long long get_page_num(unsigned long long mem_addr) {
+  if (mem_addr >= geometry.proc_mem) {
     return -1;  // Out of bounds
+  }
+  if (mem_addr >> 32) {
+    return mem_addr / geometry.page_size;
+  }
+  // mem_addr / page_size without a divide instruction
+  unsigned int addr = mem_addr;
+  unsigned int t = ((unsigned long long) addr * geometry.page_div_mul) >> 32;
+  return (t + ((addr - t) >> geometry.page_div_shift1))
+         >> geometry.page_div_shift2;
+}
+
+/**
+ * Looks up a process' page table entry for a page,
+ * without allocating any nodes.
+ *
+ * @param  page_tables Page tables in shared memory
+ * @param  pid         Simulated PID of the process
+ * @param  page_num    Page number
+ * @return             A pointer to the page table entry, or NULL
+ *                     if the page has never been touched
+ */
+page* find_page(page_tables_t* page_tables, int pid, long long page_num) {
+  unsigned int node = page_tables->roots[pid];
+  int level = 0;
+  for (; node != 0; level++) {
+    void* entries = get_node(page_tables, node);
+    unsigned int index = get_level_index(page_num, level);
+    if (level == geometry.num_levels - 1) {
+      return (page*) entries + index;
+    }
+    node = ((unsigned int*) entries)[index];
+  }
+  return NULL;
+}
+
+/**
+ * Get a process' page table entry for a page,
+ * allocating the nodes on the way to it if needed.
+ * Only the thread that owns the process may call this.
+ * 
+ * @param  page_tables Page tables in shared memory
+ * @param  pid         Simulated PID of the process
+ * @param  page_num    Page number
+ * @param  free_nodes  The calling thread's freed nodes
+ * @return             A pointer to the page table entry
+ */
+page* get_page(page_tables_t* page_tables,
+               int pid,
+               long long page_num,
+               node_list_t* free_nodes) {
+  unsigned int* child = &page_tables->roots[pid];
+  unsigned int parent = 0;
+  int level = 0;
+  for (;; level++) {
+    if (*child == 0) {
+      *child = allocate_node(page_tables, free_nodes, level);
+      if (parent != 0) {
+        (*get_node_count(page_tables, parent))++;
+      }
+    }
+    parent = *child;
+    void* entries = get_node(page_tables, *child);
+    unsigned int index = get_level_index(page_num, level);
+    if (level == geometry.num_levels - 1) {
+      return (page*) entries + index;
+    }
+    child = (unsigned int*) entries + index;
+  }
+}
+
+/**
+ * Loads a page into a frame.
+ *
+ * @param page_tables Page tables in shared memory
+ * @param pg          A page from get_page that is not loaded
+ * @param frame       The frame
+ */
+void load_page(page_tables_t* page_tables, page* pg, unsigned int frame) {
+  pg->num = frame;
+  pg->valid = 1;
+  (*get_node_count(page_tables, get_leaf(page_tables, pg)))++;
+}
+
+/**
+ * Resets a loaded page, then frees its leaf if no
+ * other page in it is loaded, and each node above
+ * that is left without children.
+ * Only the thread that owns the process may call this.
+ *
+ * @param page_tables Page tables in shared memory
+ * @param pid         Simulated PID of the process
+ * @param page_num    Page number
+ * @param free_nodes  The calling thread's freed nodes
+ */
+void unload_page(page_tables_t* page_tables,
+                 int pid,
+                 long long page_num,
+                 node_list_t* free_nodes) {
+  unsigned int* path[MAX_PAGE_TABLE_LEVELS];  // Where each node is referenced
+  unsigned int* child = &page_tables->roots[pid];
+  int level = 0;
+  for (; level < geometry.num_levels - 1; level++) {
+    path[level] = child;
+    child = (unsigned int*) get_node(page_tables, *child) +
+            get_level_index(page_num, level);
+  }
+  path[level] = child;
+  page* pg = (page*) get_node(page_tables, *child) + get_level_index(page_num, level);
+  reset_page(pg);
+
+  for (; level >= 0; level--) {
+    unsigned int node = *path[level];
+    if (--*get_node_count(page_tables, node) > 0) {
+      return;
+    }
+    free_node(page_tables, node, free_nodes);
+    *path[level] = 0;
+  }
+}
+
+/**
+ * Calls a function for each leaf of a process' page table.
+ *
+ * @param page_tables Page tables in shared memory
+ * @param pid         Simulated PID of the process
+ * @param fn          The function
+ * @param arg         Passed to the function
+ */
+void for_each_leaf(page_tables_t* page_tables, int pid, leaf_fn fn, void* arg) {
+  unsigned int root = page_tables->roots[pid];
+  if (root != 0) {
+    visit_leaves(page_tables, root, 0, 0, fn, arg);
+  }
+}
+
+/**
+ * Frees every node of a process' page table,
+ * leaving it with an empty one.
+ *
+ * @param page_tables Page tables in shared memory
+ * @param pid         Simulated PID of the process
+ * @param free_nodes  The calling thread's freed nodes
+ */
+void free_page_table(page_tables_t* page_tables, int pid, node_list_t* free_nodes) {
+  unsigned int root = page_tables->roots[pid];
+  if (root != 0) {
+    free_nodes_below(page_tables, root, 0, free_nodes);
+    page_tables->roots[pid] = 0;
+  }
+}
+
+void reset_page(page* pg) {
+  pg->num = NOT_LOADED;
+  pg->valid = 0;
+  pg->dirty = 0;
+  pg->huge = 0;
+  pg->read_ahead = 0;
+}
+
+/**
+ * Sets how many base pages a huge page spans. A huge page is an
+ * aligned region of a page table leaf, so its pages' entries sit
+ * side by side. Must be called after the page table levels are set.
+ *
+ * @param  num_pages Base pages per huge page, or 0 for no huge pages
+ * @return           0 on success. -1 if it is not a power of two from
+ *                   2 to MAX_HUGE_PAGE_PAGES, or larger than a leaf
+ *                   or the address space.
+ */
+int set_huge_page_size(int num_pages) {
+  if (num_pages == 0) {
+    geometry.huge_page_pages = 0;
+    geometry.huge_page_shift = 0;
+    return 0;
+  }
+  int leaf_pages = 1 << geometry.level_bits[geometry.num_levels - 1];
+  if (num_pages < 2 || num_pages > MAX_HUGE_PAGE_PAGES ||
+      (num_pages & (num_pages - 1)) != 0 ||
+      num_pages > leaf_pages || num_pages > geometry.num_proc_pages) {
+    return -1;
+  }
+  geometry.huge_page_pages = num_pages;
+  geometry.huge_page_shift = __builtin_ctz(num_pages);
+  return 0;
+}
+
+/**
+ * @param  pg       A page's entry
+ * @param  page_num The page's number
+ * @return          The entry of the first page of the
+ *                  huge page region the page is in
+ */
+page* get_huge_region(page* pg, long long page_num) {
+  return pg - (page_num & (geometry.huge_page_pages - 1));
+}
+
+/**
+ * @param  first The entry of a region's first page
+ * @return       1 if none of the region's pages are loaded
+ */
+int is_region_unloaded(page* first) {
+  int i = 0;
+  for (; i < geometry.huge_page_pages; i++) {
+    if (first[i].valid) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @param  first The entry of a region's first page
+ * @return       1 if every page of the region is loaded,
+ *               in consecutive frames
+ */
+int is_region_contiguous(page* first) {
+  int i = 0;
+  for (; i < geometry.huge_page_pages; i++) {
+    if (!first[i].valid || first[i].num != first->num + i) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * Marks a region's entries as one huge page.
+ * The region must be contiguous.
+ *
+ * @param first The entry of the region's first page
+ */
+void promote_region(page* first) {
+  int i = 0;
+  for (; i < geometry.huge_page_pages; i++) {
+    first[i].huge = 1;
+  }
+}
+
+/**
+ * Splits a huge page back into base pages,
+ * each still loaded in its frame.
+ *
+ * @param first The entry of the region's first page
+ */
+void demote_region(page* first) {
+  int i = 0;
+  for (; i < geometry.huge_page_pages; i++) {
+    first[i].huge = 0;
+  }
+}
+
+/**
+ * Precomputes a multiplier and shifts that divide
+ * any 32-bit address by the page size exactly,
+ * as a compiler would for a constant divisor.
+ * (Granlund and Montgomery, "Division by Invariant
+ * Integers using Multiplication", 1994)
+ *
+ * @param page_size Page size (in bytes)
+ */
+static void setup_page_division(unsigned int page_size) {
+  unsigned int l = 0;  // ceil(log2(page_size))
+  while ((1ULL << l) < page_size) {
+    l++;
+  }
+  geometry.page_div_mul =
+    (unsigned int) (((1ULL << 32) * ((1ULL << l) - page_size)) / page_size + 1);
+  geometry.page_div_shift1 = l < 1 ? l : 1;
+  geometry.page_div_shift2 = l > 1 ? l - 1 : 0;
+}
+
+/**
+ * @return Bits needed for the largest page number
+ */
+static int get_page_num_bits() {
+  int bits = 1;
+  while ((1LL << bits) < geometry.num_proc_pages) {
+    bits++;
+  }
+  return bits;
+}
+
+/**
+ * @return Nodes in a page table with every page touched
+ */
+static unsigned long long get_nodes_per_table() {
+  unsigned long long num_nodes = 0;
+  unsigned long long num_below = geometry.num_proc_pages;
+  int level = geometry.num_levels - 1;
+  for (; level >= 0; level--) {
+    int bits = geometry.level_bits[level];
+    num_below = (num_below + (1ULL << bits) - 1) >> bits;
+    num_nodes += num_below;
+  }
+  return num_nodes;
+}
+
+static void* get_node(page_tables_t* page_tables, unsigned int node) {
+  return (char*) page_tables + page_tables->node_offset +
+         geometry.node_size * node;
+}
+
+/**
+ * @return Which of a node's entries a page is under at a level
+ */
+static unsigned int get_level_index(long long page_num, int level) {
+  return (page_num >> geometry.level_shift[level]) &
+         ((1U << geometry.level_bits[level]) - 1);
+}
+
+/**
+ * Takes a node from the calling thread's freed nodes,
+ * or else one that has never been used, and empties it.
+ * Exits the program if there are none left.
+ *
+ * @param  page_tables Page tables in shared memory
+ * @param  free_nodes  The calling thread's freed nodes
+ * @param  level       Level the node is for
+ * @return             The node
+ */
+static unsigned int allocate_node(page_tables_t* page_tables,
+                                  node_list_t* free_nodes,
+                                  int level) {
+  unsigned int node = free_nodes->head;
+  if (node != 0) {
+    free_nodes->head = *(unsigned int*) get_node(page_tables, node);
+  } else {
+    node = __atomic_fetch_add(&page_tables->next_node, 1, __ATOMIC_RELAXED);
+    if (node >= page_tables->max_nodes) {
+      fprintf(stderr, "Page tables are out of shared memory\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  *get_node_count(page_tables, node) = 0;
+  void* entries = get_node(page_tables, node);
+  int num_entries = 1 << geometry.level_bits[level];
+  if (level == geometry.num_levels - 1) {
+    int i = 0;
+    for (; i < num_entries; i++) {
+      reset_page((page*) entries + i);
+    }
   } else {
-    return mem_addr / PAGE_SIZE;
+    memset(entries, 0, sizeof(unsigned int) * num_entries);
+  }
+  return node;
+}
+
+static void visit_leaves(page_tables_t* page_tables,
+                         unsigned int node,
+                         int level,
+                         long long first_page,
+                         leaf_fn fn,
+                         void* arg) {
+  void* entries = get_node(page_tables, node);
+  int num_entries = 1 << geometry.level_bits[level];
+  if (level == geometry.num_levels - 1) {
+    long long num_pages = geometry.num_proc_pages - first_page;
+    fn(first_page, entries, num_pages < num_entries ? num_pages : num_entries, arg);
+    return;
+  }
+  int i = 0;
+  for (; i < num_entries; i++) {
+    unsigned int child = ((unsigned int*) entries)[i];
+    if (child != 0) {
+      visit_leaves(page_tables,
+                   child,
+                   level + 1,
+                   first_page + ((long long) i << geometry.level_shift[level]),
+                   fn,
+                   arg);
+    }
   }
 }
 
-page* get_page(page* page_tables, int pid, int page_num) {
-  return page_tables + pid * NUM_FRAMES + page_num;
-} 
\ No newline at end of file
+static void free_nodes_below(page_tables_t* page_tables,
+                             unsigned int node,
+                             int level,
+                             node_list_t* free_nodes) {
+  void* entries = get_node(page_tables, node);
+  if (level < geometry.num_levels - 1) {
+    int num_entries = 1 << geometry.level_bits[level];
+    int i = 0;
+    for (; i < num_entries; i++) {
+      unsigned int child = ((unsigned int*) entries)[i];
+      if (child != 0) {
+        free_nodes_below(page_tables, child, level + 1, free_nodes);
+      }
+    }
+  }
+  free_node(page_tables, node, free_nodes);
+}
+
+static void free_node(page_tables_t* page_tables,
+                      unsigned int node,
+                      node_list_t* free_nodes) {
+  *(unsigned int*) get_node(page_tables, node) = free_nodes->head;
+  free_nodes->head = node;
+}
+
+/**
+ * @return Offset of node 0 in the shared memory
+ */
+static size_t get_node_offset() {
+  size_t counts_end = sizeof(page_tables_t) +
+                      sizeof(unsigned int) * geometry.max_procs +
+                      sizeof(unsigned int) * geometry.max_nodes;
+  return (counts_end + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+}
+
+/**
+ * @return How many of a node's pages are loaded,
+ *         or children allocated
+ */
+static unsigned int* get_node_count(page_tables_t* page_tables, unsigned int node) {
+  return (unsigned int*) ((char*) page_tables + page_tables->counts_offset) + node;
+}
+
+/**
+ * @return The leaf a page is in
+ */
+static unsigned int get_leaf(page_tables_t* page_tables, page* pg) {
+  return ((char*) pg - (char*) page_tables - page_tables->node_offset) /
+         geometry.node_size;
+}
@@ -1,27 +1,87 @@
 #ifndef PAGETABLE_H_
 #define PAGETABLE_H_
 
-#define MAX_PROCS 12
+#include <stddef.h>
+
+/*--------------------------------------*
+ | Default memory geometry. Overridden  |
+ | from the oss command line.           |
+ *--------------------------------------*/
+#define DEFAULT_MAX_PROCS 12
 
 // Total System Memory (in bytes)
-#define TOTAL_MEM 256000
+#define DEFAULT_TOTAL_MEM 256000
 
-#define PAGE_SIZE 1000  // (in bytes)
+#define DEFAULT_PAGE_SIZE 1000  // (in bytes)
 
-#define TOTAL_PAGES 256
+// Amount of Memory per Process (in bytes)
+#define DEFAULT_PROC_MEM 32000
 
-// Total pages / Maximum processes
-#define NUM_FRAMES 21  // frames per process
+// Largest address space a process may have (in bytes)
+#define MAX_PROC_MEM (1ULL << 48)
 
-// Amount of Memory per Process (in bytes)
-#define PROC_MEM 32000
+// Levels of a page table, and bits of the page number each may index
+#define MAX_PAGE_TABLE_LEVELS 4
+#define MAX_LEVEL_BITS 16
+
+// Most shared memory page tables may use (in bytes)
+#define MAX_PAGE_TABLES_SIZE (256ULL << 20)
+
+// Most base pages a huge page may span
+#define MAX_HUGE_PAGE_PAGES 64
+
+/**
+ * Memory geometry, set once at startup
+ */
+typedef struct geometry_t {
+  int max_procs;
+  unsigned int total_mem;       // Total System Memory (in bytes)
+  unsigned int page_size;       // (in bytes)
+  unsigned long long proc_mem;  // Amount of Memory per Process (in bytes)
+  int total_pages;              // Frames shared by every process
+  long long num_proc_pages;     // Pages in a process' address space
+
+  // Division by page_size as a multiply and shifts
+  unsigned int page_div_mul;
+  unsigned int page_div_shift1;
+  unsigned int page_div_shift2;
+
+  // Page table levels, from the root to the pages
+  int num_levels;
+  int level_bits[MAX_PAGE_TABLE_LEVELS];   // Page number bits each indexes
+  int level_shift[MAX_PAGE_TABLE_LEVELS];  // Where those bits start
+  size_t node_size;        // Bytes in a node of any level
+  unsigned int max_nodes;  // Nodes the shared memory holds
+
+  // Base pages per huge page, or 0 without huge pages
+  int huge_page_pages;
+  int huge_page_shift;
+} geometry_t;
+
+extern geometry_t geometry;
+
+// Frame is not allocated
+#define NO_OWNER -1
+
+// Page is not loaded into a frame
+#define NOT_LOADED ((unsigned int) -10)
 
 typedef struct page {
   unsigned int num;  // frame number
   unsigned char valid;
   unsigned char dirty;
+  unsigned char huge;  // 1 if part of a huge page, so its size is huge_page_pages
+  unsigned char read_ahead;  // 1 if read ahead and not yet used
 } page;
 
+/**
+ * Inverted page table entry
+ */
+typedef struct frame_t {
+  int pid;             // Owner of the frame, or NO_OWNER
+  long long page_num;  // Page loaded into the frame
+} frame_t;
+
 // I/O Operation
 typedef enum { READ, WRITE } io_op;
 
@@ -29,14 +89,77 @@ typedef enum { READ, WRITE } io_op;
  * Memory Operation
  */
 typedef struct mem_op_t {
-  int addr;  // Address of the operation
-  io_op op;  // Read or write
+  unsigned long long addr;  // Address of the operation
+  io_op op;                 // Read or write
+  unsigned long long submit_time;  // Simulated time it was made (in nanoseconds)
+  unsigned long long submit_real;  // Monotonic time it was made (in nanoseconds)
 } mem_op_t;
 
-int get_page_tables();
-page* attach_to_page_tables(int id);
-int detach_from_page_tables(page* page_tables);
-int get_page_num(unsigned int mem_addr);
-page* get_page(page* page_tables, int pid, int page_num);
+/*--------------------------------------------------*
+ | Every process' page table, as a radix tree in    |
+ | shared memory. Interior nodes hold the indexes   |
+ | of their children, and leaves hold pages. Nodes  |
+ | are allocated when a page under them is touched  |
+ | and freed when none under them are loaded, so a  |
+ | sparse 48-bit address space costs little more    |
+ | than its resident pages.                         |
+ |                                                  |
+ | A process' table is only ever changed by the     |
+ | thread that owns it. Nodes are carved from the   |
+ | shared memory with an atomic add, and freed ones |
+ | are kept on the freeing thread's own list.       |
+ *--------------------------------------------------*/
+typedef struct page_tables_t {
+  unsigned int next_node;  // Nodes before this have been handed out
+  unsigned int max_nodes;
+  size_t counts_offset;    // Of each node's loaded pages or children
+  size_t node_offset;      // Of node 0, which is never used
+  unsigned int roots[];    // Each process' root node, or 0 if it has none
+} page_tables_t;
+
+/**
+ * Nodes freed by one thread, for it to reuse
+ */
+typedef struct node_list_t {
+  unsigned int head;  // 0 if the list is empty
+} node_list_t;
+
+/**
+ * Called for each leaf of a page table, in page order.
+ *
+ * @param first_page Page number of the leaf's first page
+ * @param pages      The leaf's pages
+ * @param num_pages  Pages in the leaf within the address space
+ * @param arg        The argument given to for_each_leaf
+ */
+typedef void (*leaf_fn)(long long first_page, page* pages, int num_pages, void* arg);
+
+int set_geometry(int max_procs,
+                 unsigned int total_mem,
+                 unsigned int page_size,
+                 unsigned long long proc_mem);
+int set_page_table_levels(const int* level_bits, int num_levels);
+unsigned long long get_page_tables_size();
+void init_page_tables(page_tables_t* page_tables);
+long long get_page_num(unsigned long long mem_addr);
+page* find_page(page_tables_t* page_tables, int pid, long long page_num);
+page* get_page(page_tables_t* page_tables,
+               int pid,
+               long long page_num,
+               node_list_t* free_nodes);
+void load_page(page_tables_t* page_tables, page* pg, unsigned int frame);
+void unload_page(page_tables_t* page_tables,
+                 int pid,
+                 long long page_num,
+                 node_list_t* free_nodes);
+void for_each_leaf(page_tables_t* page_tables, int pid, leaf_fn fn, void* arg);
+void free_page_table(page_tables_t* page_tables, int pid, node_list_t* free_nodes);
+void reset_page(page* pg);
+int set_huge_page_size(int num_pages);
+page* get_huge_region(page* pg, long long page_num);
+int is_region_unloaded(page* first);
+int is_region_contiguous(page* first);
+void promote_region(page* first);
+void demote_region(page* first);
 
-#endif
\ No newline at end of file
+#endif
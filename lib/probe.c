@@ -0,0 +1,191 @@
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "probe.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+static int open_counter(unsigned long long config, int group_fd);
+static unsigned long long read_ticks();
+static void read_counters(probes_t* probes, probe_sample_t* sample);
+static double get_per_call(unsigned long long total, unsigned long long calls);
+
+static const char* phase_names[NUM_PROBE_PHASES] = {
+  "mem request",
+  "replacement",
+  "clock",
+  "wake",
+  "log"
+};
+
+/**
+ * Clears the totals and opens the hardware counters
+ * for the calling thread. Only that thread may probe.
+ * Probes still count ticks if the counters can't be opened.
+ *
+ * @param probes The probes
+ */
+void open_probes(probes_t* probes) {
+  memset(probes->phases, 0, sizeof(probes->phases));
+  probes->cache_misses_fd = -1;
+  probes->instructions_fd = open_counter(PERF_COUNT_HW_INSTRUCTIONS, -1);
+  if (probes->instructions_fd == -1) {
+    return;
+  }
+  probes->cache_misses_fd = open_counter(PERF_COUNT_HW_CACHE_MISSES,
+                                         probes->instructions_fd);
+  if (probes->cache_misses_fd == -1) {
+    close(probes->instructions_fd);
+    probes->instructions_fd = -1;
+  }
+}
+
+void close_probes(probes_t* probes) {
+  if (probes->instructions_fd != -1) {
+    close(probes->cache_misses_fd);
+    close(probes->instructions_fd);
+    probes->instructions_fd = -1;
+    probes->cache_misses_fd = -1;
+  }
+}
+
+/**
+ * Starts timing a phase.
+ *
+ * @param probes The calling thread's probes
+ * @param start  Set to the counters now
+ */
+void begin_probe(probes_t* probes, probe_sample_t* start) {
+  read_counters(probes, start);
+  start->ticks = read_ticks();
+}
+
+/**
+ * Adds the counters since begin_probe to a phase.
+ *
+ * @param probes The calling thread's probes
+ * @param phase  The phase that was timed
+ * @param start  The counters begin_probe read
+ */
+void end_probe(probes_t* probes, probe_phase phase, probe_sample_t* start) {
+  unsigned long long ticks = read_ticks();
+  probe_sample_t end;
+  read_counters(probes, &end);
+  probe_totals_t* totals = &probes->phases[phase];
+  totals->calls++;
+  totals->ticks += ticks - start->ticks;
+  totals->instructions += end.instructions - start->instructions;
+  totals->cache_misses += end.cache_misses - start->cache_misses;
+}
+
+/**
+ * Adds one thread's totals to another's.
+ * Neither thread may be probing.
+ */
+void merge_probes(probes_t* dest, probes_t* src) {
+  int i = 0;
+  for (; i < NUM_PROBE_PHASES; i++) {
+    dest->phases[i].calls += src->phases[i].calls;
+    dest->phases[i].ticks += src->phases[i].ticks;
+    dest->phases[i].instructions += src->phases[i].instructions;
+    dest->phases[i].cache_misses += src->phases[i].cache_misses;
+  }
+}
+
+/**
+ * Prints the average cost of a call to each phase,
+ * and its share of the ticks spent in every phase.
+ *
+ * @param out    Where to print
+ * @param probes The totals
+ */
+void print_probes(FILE* out, probes_t* probes) {
+  unsigned long long total_ticks = 0;
+  unsigned long long total_instructions = 0;
+  int i = 0;
+  for (; i < NUM_PROBE_PHASES; i++) {
+    total_ticks += probes->phases[i].ticks;
+    total_instructions += probes->phases[i].instructions;
+  }
+  fprintf(out, "%-12s %12s %8s %12s %14s %14s\n",
+          "phase", "calls", "share", "ticks/call",
+          "instrs/call", "misses/call");
+  for (i = 0; i < NUM_PROBE_PHASES; i++) {
+    probe_totals_t* totals = &probes->phases[i];
+    double share = total_ticks ? (double) totals->ticks * 100 / total_ticks : 0;
+    fprintf(out, "%-12s %12llu %7.2f%% %12.1f",
+            phase_names[i],
+            totals->calls,
+            share,
+            get_per_call(totals->ticks, totals->calls));
+    if (total_instructions > 0) {
+      fprintf(out, " %14.1f %14.2f\n",
+              get_per_call(totals->instructions, totals->calls),
+              get_per_call(totals->cache_misses, totals->calls));
+    } else {
+      fprintf(out, " %14s %14s\n", "-", "-");
+    }
+  }
+  if (total_instructions == 0) {
+    fprintf(out, "Hardware counters are unavailable, so only ticks were counted.\n");
+  }
+}
+
+/**
+ * Opens a hardware counter of the calling thread's user space work.
+ *
+ * @param config   Which counter
+ * @param group_fd The group's leader, or -1 to lead a new group
+ * @return         The counter, or -1 if it can't be opened
+ */
+static int open_counter(unsigned long long config, int group_fd) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+/**
+ * @return The time stamp counter, or nanoseconds
+ *         on machines without one
+ */
+static unsigned long long read_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long long) now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+/**
+ * Reads both hardware counters with one system call.
+ */
+static void read_counters(probes_t* probes, probe_sample_t* sample) {
+  struct {
+    unsigned long long num_counters;
+    unsigned long long values[2];
+  } group;
+  if (probes->instructions_fd == -1 ||
+      read(probes->instructions_fd, &group, sizeof(group)) != sizeof(group)) {
+    sample->instructions = 0;
+    sample->cache_misses = 0;
+    return;
+  }
+  sample->instructions = group.values[0];
+  sample->cache_misses = group.values[1];
+}
+
+static double get_per_call(unsigned long long total, unsigned long long calls) {
+  return calls ? (double) total / calls : 0;
+}
@@ -0,0 +1,56 @@
+#ifndef PROBE_H_
+#define PROBE_H_
+
+#include <stdio.h>
+
+/**
+ * Parts of handling requests that are timed
+ */
+typedef enum {
+  PROBE_MEM_REQUEST,  // handle_mem_request, including its log message
+  PROBE_REPLACEMENT,  // run_page_replacement
+  PROBE_CLOCK,        // Atomic add of a batch's time to the clock
+  PROBE_WAKE,         // sem_post waking a process
+  PROBE_LOG,          // Appending records to the log
+  NUM_PROBE_PHASES
+} probe_phase;
+
+/**
+ * Counters read when a phase starts or ends
+ */
+typedef struct probe_sample_t {
+  unsigned long long ticks;
+  unsigned long long instructions;
+  unsigned long long cache_misses;
+} probe_sample_t;
+
+/**
+ * Totals for one phase
+ */
+typedef struct probe_totals_t {
+  unsigned long long calls;
+  unsigned long long ticks;
+  unsigned long long instructions;
+  unsigned long long cache_misses;
+} probe_totals_t;
+
+/*-----------------------------------------------*
+ | Time stamp counter ticks, and instructions    |
+ | and cache misses where the hardware counters  |
+ | can be opened, spent in each phase by the     |
+ | thread that opened the probes.                |
+ *-----------------------------------------------*/
+typedef struct probes_t {
+  int instructions_fd;  // Group leader, or -1 without hardware counters
+  int cache_misses_fd;
+  probe_totals_t phases[NUM_PROBE_PHASES];
+} probes_t;
+
+void open_probes(probes_t* probes);
+void close_probes(probes_t* probes);
+void begin_probe(probes_t* probes, probe_sample_t* start);
+void end_probe(probes_t* probes, probe_phase phase, probe_sample_t* start);
+void merge_probes(probes_t* dest, probes_t* src);
+void print_probes(FILE* out, probes_t* probes);
+
+#endif
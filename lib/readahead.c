@@ -0,0 +1,103 @@
+#include "readahead.h"
+
+/**
+ * Starts a process with no stream.
+ *
+ * @param ra         The process' read-ahead
+ * @param max_window Most pages a batch may read
+ */
+void init_readahead(readahead_t* ra, int max_window) {
+  ra->last_page = -1;
+  ra->stride = 0;
+  ra->is_stream = 0;
+  ra->max_window = max_window;
+  ra->window = INITIAL_READAHEAD_WINDOW < max_window ? INITIAL_READAHEAD_WINDOW
+                                                     : max_window;
+  ra->next_page = 0;
+  ra->marker = -1;
+  ra->ready_at = 0;
+  ra->prev_ready_at = 0;
+}
+
+/**
+ * Follows a page fault. If it continues a stream,
+ * the next batch starts one stride past it.
+ *
+ * @param  ra       The process' read-ahead
+ * @param  page_num The page that faulted
+ * @return          1 if a batch should be read. 0 otherwise.
+ */
+int observe_fault(readahead_t* ra, long long page_num) {
+  long long stride = page_num - ra->last_page;
+  ra->is_stream = stride != 0 && stride == ra->stride;
+  ra->stride = stride;
+  ra->last_page = page_num;
+  if (!ra->is_stream) {
+    return 0;
+  }
+  ra->next_page = page_num + stride;
+  return 1;
+}
+
+/**
+ * Follows the first use of a page that was read ahead,
+ * and grows the window since the page was wanted.
+ *
+ * @param  ra       The process' read-ahead
+ * @param  page_num The page
+ * @return          1 if it is the first page of the last batch
+ *                  of a stream, so the next batch should be read.
+ *                  0 otherwise.
+ */
+int observe_readahead_use(readahead_t* ra, long long page_num) {
+  if (ra->window < ra->max_window) {
+    ra->window++;
+  }
+  long long stride = page_num - ra->last_page;
+  if (stride != ra->stride) {
+    ra->is_stream = 0;
+    ra->stride = stride;
+  }
+  ra->last_page = page_num;
+  return ra->is_stream && page_num == ra->marker;
+}
+
+/**
+ * Shrinks the window after a page read ahead was evicted unused.
+ */
+void observe_readahead_waste(readahead_t* ra) {
+  if (ra->window > 1) {
+    ra->window /= 2;
+  }
+}
+
+/**
+ * Records a batch that was read.
+ *
+ * @param ra        The process' read-ahead
+ * @param next_page First page after the batch, where the next one starts
+ * @param ready_at  Simulated time the batch is in memory (in nanoseconds)
+ */
+void record_readahead_batch(readahead_t* ra,
+                            long long next_page,
+                            unsigned long long ready_at) {
+  ra->marker = ra->next_page;
+  ra->next_page = next_page;
+  ra->prev_ready_at = ra->ready_at;
+  ra->ready_at = ready_at;
+}
+
+/**
+ * Pages from the marker on belong to the last batch. Earlier
+ * pages of the stream belong to the one before it, or an
+ * even older batch, which is in memory by then too.
+ *
+ * @param  ra       The process' read-ahead
+ * @param  page_num A page that was read ahead
+ * @return          Simulated time the page is in memory (in nanoseconds)
+ */
+unsigned long long get_readahead_ready(readahead_t* ra, long long page_num) {
+  int is_in_last_batch = ra->stride > 0 ? page_num >= ra->marker
+                                        : page_num <= ra->marker;
+  return is_in_last_batch ? ra->ready_at : ra->prev_ready_at;
+}
@@ -0,0 +1,41 @@
+#ifndef READAHEAD_H_
+#define READAHEAD_H_
+
+// Pages a stream's first batch reads ahead, and the
+// most any batch may read, by default and at all
+#define INITIAL_READAHEAD_WINDOW 4
+#define DEFAULT_MAX_READAHEAD 16
+#define MAX_READAHEAD_PAGES 256
+
+/*----------------------------------------------------*
+ | One process' read-ahead. Faults form a stream once |
+ | two in a row are the same stride of pages apart.   |
+ | Each batch of a stream reads the next window pages |
+ | of it, and reading the first page of a batch sets  |
+ | off the next, so one batch is always in flight     |
+ | ahead of the process. The window grows by a page   |
+ | for every page read ahead that is used and halves  |
+ | for every one evicted unused.                      |
+ *----------------------------------------------------*/
+typedef struct readahead_t {
+  long long last_page;  // Last page of the stream faulted on or used
+  long long stride;     // Pages between its references
+  int is_stream;        // Whether the stride has repeated
+  int window;           // Pages the next batch reads
+  int max_window;
+  long long next_page;  // First page the next batch reads
+  long long marker;     // First page of the last batch
+  unsigned long long ready_at;       // When the last batch is in memory
+  unsigned long long prev_ready_at;  // When the batch before it was
+} readahead_t;
+
+void init_readahead(readahead_t* ra, int max_window);
+int observe_fault(readahead_t* ra, long long page_num);
+int observe_readahead_use(readahead_t* ra, long long page_num);
+void observe_readahead_waste(readahead_t* ra);
+void record_readahead_batch(readahead_t* ra,
+                            long long next_page,
+                            unsigned long long ready_at);
+unsigned long long get_readahead_ready(readahead_t* ra, long long page_num);
+
+#endif
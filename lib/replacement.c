@@ -0,0 +1,373 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "replacement.h"
+
+#define NIL -1
+
+// Which list a frame or key is on
+enum { NONE, T1, T2, B1, B2 };
+
+/**
+ * Doubly linked list threaded through prev and next arrays.
+ * The head is the least recently used end.
+ */
+typedef struct list_t {
+  int head;
+  int tail;
+  int size;
+} list_t;
+
+struct replacement_t {
+  policy_type type;
+  int num_frames;
+  int num_keys;
+
+  // Resident frames
+  int* frame_prev;
+  int* frame_next;
+  int* frame_key;
+  unsigned char* frame_list;
+  list_t t1;  // FIFO queue, LRU list or ARC T1
+  list_t t2;  // ARC T2
+
+  // Pages ARC remembers after evicting them
+  int* key_prev;
+  int* key_next;
+  unsigned char* key_list;
+  list_t b1;
+  list_t b2;
+  int p;  // ARC's target size for T1
+
+  // Clock
+  unsigned char* referenced;
+  int hand;
+};
+
+static const char* policy_names[NUM_POLICIES] = {
+  "fifo", "lru", "clock", "arc"
+};
+
+static void* allocate(size_t size);
+static void init_list(list_t* list);
+static void list_push(list_t* list, int* prev, int* next, int node);
+static void list_remove(list_t* list, int* prev, int* next, int node);
+static void move_to_ghost(replacement_t* r, int frame, int ghost);
+static void arc_insert(replacement_t* r, int frame, int key);
+static int arc_select_victim(replacement_t* r);
+static int clock_select_victim(replacement_t* r);
+static int max(int a, int b);
+static int min(int a, int b);
+
+/**
+ * Creates the state for a replacement policy.
+ * 
+ * @param  type       The policy
+ * @param  num_frames Number of frames the policy chooses among
+ * @param  num_keys   Number of distinct pages that can be inserted
+ * @return            A pointer to the new state
+ */
+replacement_t* create_replacement(policy_type type, int num_frames, int num_keys) {
+  replacement_t* r = allocate(sizeof(replacement_t));
+  r->type = type;
+  r->num_frames = num_frames;
+  r->num_keys = num_keys;
+  r->frame_prev = allocate(sizeof(int) * num_frames);
+  r->frame_next = allocate(sizeof(int) * num_frames);
+  r->frame_key = allocate(sizeof(int) * num_frames);
+  r->frame_list = allocate(num_frames);
+  r->referenced = allocate(num_frames);
+  r->key_prev = allocate(sizeof(int) * num_keys);
+  r->key_next = allocate(sizeof(int) * num_keys);
+  r->key_list = allocate(num_keys);
+  reset_replacement(r);
+  return r;
+}
+
+void destroy_replacement(replacement_t* r) {
+  free(r->frame_prev);
+  free(r->frame_next);
+  free(r->frame_key);
+  free(r->frame_list);
+  free(r->referenced);
+  free(r->key_prev);
+  free(r->key_next);
+  free(r->key_list);
+  free(r);
+}
+
+/**
+ * Forgets every frame and every remembered page.
+ * 
+ * @param r A pointer to the policy state
+ */
+void reset_replacement(replacement_t* r) {
+  memset(r->frame_list, NONE, r->num_frames);
+  memset(r->referenced, 0, r->num_frames);
+  memset(r->key_list, NONE, r->num_keys);
+  init_list(&r->t1);
+  init_list(&r->t2);
+  init_list(&r->b1);
+  init_list(&r->b2);
+  r->p = 0;
+  r->hand = 0;
+}
+
+/**
+ * Tells the policy a page was loaded into a frame.
+ * 
+ * @param r     A pointer to the policy state
+ * @param frame The frame
+ * @param key   The page now in the frame
+ */
+void replacement_insert(replacement_t* r, int frame, int key) {
+  r->frame_key[frame] = key;
+  r->referenced[frame] = 1;
+  if (r->type == ARC) {
+    arc_insert(r, frame, key);
+  } else {
+    r->frame_list[frame] = T1;
+    list_push(&r->t1, r->frame_prev, r->frame_next, frame);
+  }
+}
+
+/**
+ * Tells the policy a resident page was referenced.
+ * 
+ * @param r     A pointer to the policy state
+ * @param frame The frame holding the page
+ */
+void replacement_access(replacement_t* r, int frame) {
+  switch (r->type) {
+    case FIFO:
+      break;
+    case LRU:
+      list_remove(&r->t1, r->frame_prev, r->frame_next, frame);
+      list_push(&r->t1, r->frame_prev, r->frame_next, frame);
+      break;
+    case CLOCK:
+      r->referenced[frame] = 1;
+      break;
+    case ARC:
+      list_remove(r->frame_list[frame] == T1 ? &r->t1 : &r->t2,
+                  r->frame_prev, r->frame_next, frame);
+      r->frame_list[frame] = T2;
+      list_push(&r->t2, r->frame_prev, r->frame_next, frame);
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * Chooses the next frame to evict.
+ * The frame stays resident until replacement_evict is called.
+ * 
+ * @param r A pointer to the policy state
+ * @return  The frame, or NO_VICTIM if no frame is resident
+ */
+int replacement_select_victim(replacement_t* r) {
+  switch (r->type) {
+    case CLOCK:
+      return clock_select_victim(r);
+    case ARC:
+      return arc_select_victim(r);
+    default:
+      return r->t1.size ? r->t1.head : NO_VICTIM;
+  }
+}
+
+/**
+ * Removes an evicted frame.
+ * ARC remembers the page that was in it.
+ * 
+ * @param r     A pointer to the policy state
+ * @param frame The frame
+ */
+void replacement_evict(replacement_t* r, int frame) {
+  if (r->type == ARC) {
+    move_to_ghost(r, frame, r->frame_list[frame] == T1 ? B1 : B2);
+  } else {
+    replacement_forget(r, frame);
+  }
+}
+
+/**
+ * Removes a frame without remembering its page,
+ * such as when its process terminates.
+ * 
+ * @param r     A pointer to the policy state
+ * @param frame The frame
+ */
+void replacement_forget(replacement_t* r, int frame) {
+  switch (r->frame_list[frame]) {
+    case T1:
+      list_remove(&r->t1, r->frame_prev, r->frame_next, frame);
+      break;
+    case T2:
+      list_remove(&r->t2, r->frame_prev, r->frame_next, frame);
+      break;
+    default:
+      return;
+  }
+  r->frame_list[frame] = NONE;
+  r->referenced[frame] = 0;
+}
+
+const char* get_policy_name(policy_type type) {
+  return policy_names[type];
+}
+
+/**
+ * @param  name A policy name such as "lru"
+ * @return      The matching policy_type, or -1 if there is none
+ */
+int parse_policy_name(const char* name) {
+  int i = 0;
+  for (; i < NUM_POLICIES; i++) {
+    if (strcmp(name, policy_names[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void* allocate(size_t size) {
+  void* ptr = malloc(size);
+  if (ptr == NULL) {
+    perror("Failed to allocate page replacement state");
+    exit(EXIT_FAILURE);
+  }
+  return ptr;
+}
+
+static void init_list(list_t* list) {
+  list->head = NIL;
+  list->tail = NIL;
+  list->size = 0;
+}
+
+/**
+ * Appends a node at the most recently used end.
+ */
+static void list_push(list_t* list, int* prev, int* next, int node) {
+  prev[node] = list->tail;
+  next[node] = NIL;
+  if (list->tail == NIL) {
+    list->head = node;
+  } else {
+    next[list->tail] = node;
+  }
+  list->tail = node;
+  list->size++;
+}
+
+static void list_remove(list_t* list, int* prev, int* next, int node) {
+  if (prev[node] == NIL) {
+    list->head = next[node];
+  } else {
+    next[prev[node]] = next[node];
+  }
+  if (next[node] == NIL) {
+    list->tail = prev[node];
+  } else {
+    prev[next[node]] = prev[node];
+  }
+  list->size--;
+}
+
+/**
+ * Evicts a frame and records its page on a ghost list.
+ * Pages can share a key, so the key may already be on one.
+ */
+static void move_to_ghost(replacement_t* r, int frame, int ghost) {
+  int key = r->frame_key[frame];
+  replacement_forget(r, frame);
+  if (r->key_list[key] == B1) {
+    list_remove(&r->b1, r->key_prev, r->key_next, key);
+  } else if (r->key_list[key] == B2) {
+    list_remove(&r->b2, r->key_prev, r->key_next, key);
+  }
+  r->key_list[key] = ghost;
+  list_push(ghost == B1 ? &r->b1 : &r->b2, r->key_prev, r->key_next, key);
+}
+
+/**
+ * Adaptive Replacement Cache insertion (Megiddo and Modha).
+ * A page found on a ghost list adapts p and goes straight to T2.
+ */
+static void arc_insert(replacement_t* r, int frame, int key) {
+  int c = r->num_frames;
+  if (r->key_list[key] == B1) {
+    int ratio = r->b1.size ? r->b2.size / r->b1.size : 1;
+    r->p = min(c, r->p + max(ratio, 1));
+    list_remove(&r->b1, r->key_prev, r->key_next, key);
+    r->key_list[key] = NONE;
+    r->frame_list[frame] = T2;
+    list_push(&r->t2, r->frame_prev, r->frame_next, frame);
+    return;
+  }
+  if (r->key_list[key] == B2) {
+    int ratio = r->b2.size ? r->b1.size / r->b2.size : 1;
+    r->p = max(0, r->p - max(ratio, 1));
+    list_remove(&r->b2, r->key_prev, r->key_next, key);
+    r->key_list[key] = NONE;
+    r->frame_list[frame] = T2;
+    list_push(&r->t2, r->frame_prev, r->frame_next, frame);
+    return;
+  }
+
+  // Keep |T1| + |B1| <= c and the ghost lists within 2c in total
+  int total = r->t1.size + r->t2.size + r->b1.size + r->b2.size;
+  if (r->t1.size + r->b1.size >= c && r->b1.size > 0) {
+    int lru = r->b1.head;
+    list_remove(&r->b1, r->key_prev, r->key_next, lru);
+    r->key_list[lru] = NONE;
+  } else if (total >= 2 * c && r->b2.size > 0) {
+    int lru = r->b2.head;
+    list_remove(&r->b2, r->key_prev, r->key_next, lru);
+    r->key_list[lru] = NONE;
+  }
+  r->frame_list[frame] = T1;
+  list_push(&r->t1, r->frame_prev, r->frame_next, frame);
+}
+
+/**
+ * Evicts from T1 while it is larger than its target size p.
+ */
+static int arc_select_victim(replacement_t* r) {
+  if (r->t1.size > 0 && (r->t1.size > r->p || r->t2.size == 0)) {
+    return r->t1.head;
+  }
+  return r->t2.size ? r->t2.head : NO_VICTIM;
+}
+
+/**
+ * Second chance: sweeps the hand past referenced
+ * frames, clearing their reference bit as it goes.
+ */
+static int clock_select_victim(replacement_t* r) {
+  if (r->t1.size == 0) {
+    return NO_VICTIM;
+  }
+  for (;;) {
+    int frame = r->hand;
+    r->hand = (r->hand + 1) % r->num_frames;
+    if (r->frame_list[frame] == NONE) {
+      continue;
+    }
+    if (r->referenced[frame]) {
+      r->referenced[frame] = 0;
+    } else {
+      return frame;
+    }
+  }
+}
+
+static int max(int a, int b) {
+  return a > b ? a : b;
+}
+
+static int min(int a, int b) {
+  return a < b ? a : b;
+}
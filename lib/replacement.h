@@ -0,0 +1,32 @@
+#ifndef REPLACEMENT_H_
+#define REPLACEMENT_H_
+
+// No frame can be evicted
+#define NO_VICTIM -1
+
+/*-----------------------------*
+ | Page Replacement Policies   |
+ *-----------------------------*/
+typedef enum { FIFO, LRU, CLOCK, ARC, NUM_POLICIES } policy_type;
+
+/**
+ * State for one policy over a fixed set of frames.
+ *
+ * Frames are numbered 0 to num_frames - 1.
+ * Keys identify pages, 0 to num_keys - 1, so ARC can
+ * remember pages after they have been evicted.
+ */
+typedef struct replacement_t replacement_t;
+
+replacement_t* create_replacement(policy_type type, int num_frames, int num_keys);
+void destroy_replacement(replacement_t* r);
+void reset_replacement(replacement_t* r);
+void replacement_insert(replacement_t* r, int frame, int key);
+void replacement_access(replacement_t* r, int frame);
+int replacement_select_victim(replacement_t* r);
+void replacement_evict(replacement_t* r, int frame);
+void replacement_forget(replacement_t* r, int frame);
+const char* get_policy_name(policy_type type);
+int parse_policy_name(const char* name);
+
+#endif
@@ -0,0 +1,164 @@
+#include "ring.h"
+
+#define RING_MASK (RING_SIZE - 1)
+
+#define load_acquire(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define store_release(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static size_t get_ring_offset(int num_procs);
+
+/**
+ * @param  num_procs Maximum number of processes
+ * @return           Bytes of shared memory needed for the memory rings
+ */
+size_t get_mem_rings_size(int num_procs) {
+  return get_ring_offset(num_procs) + sizeof(mem_ring_t) * num_procs;
+}
+
+/**
+ * Sets up the doorbell and every process' ring.
+ *
+ * @param mem_rings   A pointer to the shared memory for memory rings
+ * @param num_procs   Maximum number of processes
+ * @param num_workers Number of oss worker threads serving the rings
+ * @param spin        Times user retries before sleeping on its ring
+ */
+void init_mem_rings(mem_rings_t* mem_rings,
+                    int num_procs,
+                    int num_workers,
+                    unsigned int spin) {
+  mem_rings->ring_offset = get_ring_offset(num_procs);
+  init_doorbell(&mem_rings->doorbell, num_procs, num_workers);
+  int i = 0;
+  for (; i < num_procs; i++) {
+    init_ring(get_ring(mem_rings, i), spin);
+  }
+}
+
+/**
+ * @param  mem_rings A pointer to the shared memory for memory rings
+ * @param  pid       Simulated PID of a process
+ * @return           A pointer to the process' ring
+ */
+mem_ring_t* get_ring(mem_rings_t* mem_rings, int pid) {
+  return (mem_ring_t*) ((char*) mem_rings + mem_rings->ring_offset) + pid;
+}
+
+/**
+ * Empties both queues of a ring.
+ *
+ * @param ring A pointer to a ring
+ * @param spin Times user retries before sleeping on the ring
+ */
+void init_ring(mem_ring_t* ring, unsigned int spin) {
+  ring->sq_head = 0;
+  ring->sq_tail = 0;
+  ring->cq_head = 0;
+  ring->cq_tail = 0;
+  init_sem(&ring->sem, 0, spin);
+}
+
+/**
+ * Posts a memory operation to the submission queue.
+ *
+ * Called by user. The caller is responsible for never
+ * having more than RING_SIZE operations in flight so
+ * the completion queue can not overflow.
+ *
+ * @param ring   A pointer to a ring
+ * @param mem_op The operation to submit
+ * @return       1 on success. 0 if the queue is full.
+ */
+int ring_submit(mem_ring_t* ring, mem_op_t* mem_op) {
+  unsigned int tail = ring->sq_tail;
+  if (tail - load_acquire(&ring->sq_head) == RING_SIZE) {
+    return 0;
+  }
+  ring->sq[tail & RING_MASK] = *mem_op;
+  store_release(&ring->sq_tail, tail + 1);
+  return 1;
+}
+
+/**
+ * @param ring A pointer to a ring
+ * @return     1 if there is a submission waiting. 0 otherwise.
+ */
+int ring_has_submission(mem_ring_t* ring) {
+  return load_acquire(&ring->sq_tail) != ring->sq_head;
+}
+
+/**
+ * Takes the oldest operation off the submission queue.
+ *
+ * Called by oss.
+ *
+ * @param ring   A pointer to a ring
+ * @param mem_op Set to the submitted operation
+ * @return       1 if an operation was taken. 0 if the queue is empty.
+ */
+int ring_get_submission(mem_ring_t* ring, mem_op_t* mem_op) {
+  unsigned int head = ring->sq_head;
+  if (head == load_acquire(&ring->sq_tail)) {
+    return 0;
+  }
+  *mem_op = ring->sq[head & RING_MASK];
+  store_release(&ring->sq_head, head + 1);
+  return 1;
+}
+
+/**
+ * Posts a completion for a previously submitted operation.
+ *
+ * Called by oss.
+ *
+ * @param ring A pointer to a ring
+ * @param cqe  The completion
+ */
+void ring_complete(mem_ring_t* ring, mem_cqe_t* cqe) {
+  unsigned int tail = ring->cq_tail;
+  ring->cq[tail & RING_MASK] = *cqe;
+  store_release(&ring->cq_tail, tail + 1);
+}
+
+/**
+ * Takes the oldest completion off the completion queue.
+ *
+ * Called by user.
+ *
+ * @param ring A pointer to a ring
+ * @param cqe  Set to the completion
+ * @return     1 if a completion was taken. 0 if the queue is empty.
+ */
+int ring_reap(mem_ring_t* ring, mem_cqe_t* cqe) {
+  unsigned int head = ring->cq_head;
+  if (head == load_acquire(&ring->cq_tail)) {
+    return 0;
+  }
+  *cqe = ring->cq[head & RING_MASK];
+  store_release(&ring->cq_head, head + 1);
+  return 1;
+}
+
+/**
+ * Takes every available completion off the completion queue.
+ *
+ * Called by user.
+ *
+ * @param ring A pointer to a ring
+ * @return     The number of completions taken
+ */
+int ring_reap_all(mem_ring_t* ring) {
+  unsigned int head = ring->cq_head;
+  unsigned int tail = load_acquire(&ring->cq_tail);
+  store_release(&ring->cq_head, tail);
+  return tail - head;
+}
+
+/**
+ * Rings start on a cache line after the doorbell's pending bits.
+ */
+static size_t get_ring_offset(int num_procs) {
+  size_t header_size = offsetof(mem_rings_t, doorbell) +
+                       get_doorbell_size(num_procs);
+  return (header_size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+}
@@ -0,0 +1,60 @@
+#ifndef RING_H_
+#define RING_H_
+
+#include <stddef.h>
+#include "doorbell.h"
+#include "pagetable.h"
+#include "sem.h"
+
+// Entries per queue (must be a power of two)
+#define RING_SIZE 16
+
+/**
+ * Memory Operation Completion
+ */
+typedef struct mem_cqe_t {
+  long long page_num;  // Page the request resolved to, or -1 if
+                       // the address is outside the address space
+  int page_fault;      // 1 if the request caused a page fault
+} mem_cqe_t;
+
+/*---------------------------------------------*
+ | Per-process submission and completion rings |
+ |                                             |
+ | user produces into sq and consumes from cq. |
+ | oss consumes from sq and produces into cq.  |
+ *---------------------------------------------*/
+typedef struct mem_ring_t {
+  unsigned int sq_head __attribute__((aligned(CACHE_LINE)));
+  unsigned int sq_tail __attribute__((aligned(CACHE_LINE)));
+  unsigned int cq_head __attribute__((aligned(CACHE_LINE)));
+  unsigned int cq_tail __attribute__((aligned(CACHE_LINE)));
+  mem_op_t sq[RING_SIZE] __attribute__((aligned(CACHE_LINE)));
+  mem_cqe_t cq[RING_SIZE];
+  futex_sem sem;  // Posted by oss after completing a batch
+} mem_ring_t;
+
+/**
+ * Header of the shared memory for memory rings.
+ * One ring per process follows at ring_offset.
+ */
+typedef struct mem_rings_t {
+  unsigned long ring_offset;  // Bytes from the header to the first ring
+  doorbell_t doorbell;        // Last, since its pending bits follow it
+} mem_rings_t;
+
+size_t get_mem_rings_size(int num_procs);
+void init_mem_rings(mem_rings_t* mem_rings,
+                    int num_procs,
+                    int num_workers,
+                    unsigned int spin);
+mem_ring_t* get_ring(mem_rings_t* mem_rings, int pid);
+void init_ring(mem_ring_t* ring, unsigned int spin);
+int ring_submit(mem_ring_t* ring, mem_op_t* mem_op);
+int ring_has_submission(mem_ring_t* ring);
+int ring_get_submission(mem_ring_t* ring, mem_op_t* mem_op);
+void ring_complete(mem_ring_t* ring, mem_cqe_t* cqe);
+int ring_reap(mem_ring_t* ring, mem_cqe_t* cqe);
+int ring_reap_all(mem_ring_t* ring);
+
+#endif
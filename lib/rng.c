@@ -0,0 +1,29 @@
+#include "rng.h"
+
+static unsigned long long splitmix64(unsigned long long* x);
+
+/**
+ * Seeds a generator. Every seed, including 0, gives a
+ * state that is not all zeros, and nearby seeds give
+ * unrelated sequences.
+ *
+ * @param rng  The generator
+ * @param seed The seed
+ */
+void seed_rng(rng_t* rng, unsigned long long seed) {
+  int i = 0;
+  for (; i < 4; i++) {
+    rng->s[i] = splitmix64(&seed);
+  }
+}
+
+/**
+ * Steps a splitmix64 generator, the recommended
+ * way to expand a seed into xoshiro's state.
+ */
+static unsigned long long splitmix64(unsigned long long* x) {
+  unsigned long long z = (*x += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
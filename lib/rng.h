@@ -0,0 +1,59 @@
+#ifndef RNG_H_
+#define RNG_H_
+
+/*-----------------------------------------------*
+ | xoshiro256** pseudorandom number generator.   |
+ | (Blackman and Vigna, "Scrambled Linear        |
+ | Pseudorandom Number Generators", 2018)        |
+ |                                               |
+ | Each simulated process has its own, so runs   |
+ | with the same seed make the same references,  |
+ | and no lock is shared as rand() shares one.   |
+ *-----------------------------------------------*/
+typedef struct rng_t {
+  unsigned long long s[4];
+} rng_t;
+
+void seed_rng(rng_t* rng, unsigned long long seed);
+
+static inline unsigned long long rotate_left(unsigned long long x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * @return The next 64 random bits
+ */
+static inline unsigned long long rng_next(rng_t* rng) {
+  unsigned long long* s = rng->s;
+  unsigned long long result = rotate_left(s[1] * 5, 7) * 9;
+  unsigned long long t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotate_left(s[3], 45);
+  return result;
+}
+
+/**
+ * A number from 0 to n - 1, by the high half of a
+ * multiply instead of a divide. The bias is at most
+ * n / 2^64, too small to matter here.
+ * (Lemire, "Fast Random Integer Generation in an Interval", 2019)
+ *
+ * @param  n The number of values, at least 1
+ * @return   The number
+ */
+static inline unsigned long long rng_below(rng_t* rng, unsigned long long n) {
+  return (unsigned long long) (((unsigned __int128) rng_next(rng) * n) >> 64);
+}
+
+/**
+ * @return A number in [0, 1)
+ */
+static inline double rng_double(rng_t* rng) {
+  return (rng_next(rng) >> 11) * 0x1.0p-53;
+}
+
+#endif
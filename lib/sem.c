@@ -1,67 +1,164 @@
-#include <stdlib.h>
-#include <stdio.h>
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
 #include "sem.h"
 
-int allocate_sem(key_t key, int sem_flags) {
-  return semget(key, 1, sem_flags);
-}
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax()
+#endif
 
-int deallocate_sem(int sem_id) {
-  union semun ignored_argument;
-  int success = semctl(sem_id, 1, IPC_RMID, ignored_argument);
-  if (success == -1) {
-    perror("Failed to deallocate binary semaphore");
-    exit(EXIT_FAILURE);
-  }
-  return success;
+static int futex(unsigned int* uaddr,
+                 int op,
+                 unsigned int val,
+                 struct timespec* timeout);
+static int try_decrement(futex_sem* sem);
+
+/**
+ * Initializes a semaphore in shared memory.
+ * 
+ * @param sem         A pointer to the semaphore
+ * @param initial_val The initial value
+ * @param spin        Times to retry before sleeping. 0 to sleep right away.
+ */
+void init_sem(futex_sem* sem, unsigned int initial_val, unsigned int spin) {
+  sem->val = initial_val;
+  sem->waiters = 0;
+  sem->spin = spin;
 }
 
-int init_sem(int sem_id, int initial_val) {
-  union semun argument;
-  unsigned short values[1];
-  values[0] = initial_val;
-  argument.array = values;
-  int success = semctl(sem_id, 0, SETALL, argument);
-  if (success == -1) {
-    perror("Faled to initilaize binary semaphore");
-    exit(EXIT_FAILURE);
+/**
+ * Wakes every process asleep on a semaphore
+ * so none are left blocked once it goes away.
+ * 
+ * @param sem A pointer to the semaphore
+ */
+void deallocate_sem(futex_sem* sem) {
+  if (__atomic_load_n(&sem->waiters, __ATOMIC_SEQ_CST)) {
+    futex_wake(&sem->val, INT_MAX);
   }
-  return success;
 }
 
 /**
- * Wait on a binary semaphore.
+ * Wait on a semaphore.
  * Block until the semaphore value is positive,
  * then decrement it by 1.
+ *
+ * Takes no system call when the semaphore is
+ * already positive or becomes positive while spinning.
  * 
- * @param sem_id The semaphore's id
- * @return The return value of semop
+ * @param sem A pointer to the semaphore
+ * @return 0 on success. -1 if interrupted by a signal.
  */
-int sem_wait(int sem_id) {
-  struct sembuf operations[1];
-  /* Use the first (and only) semaphore. */
-  operations[0].sem_num = 0;
-  /* Decrement by 1. */
-  operations[0].sem_op = -1;
-  /* Permit undo'ing. */
-  operations[0].sem_flg = SEM_UNDO;
-  return semop(sem_id, operations, 1);
+int sem_wait(futex_sem* sem) {
+  unsigned int i = 0;
+  for (; i <= sem->spin; i++) {
+    if (try_decrement(sem)) {
+      return 0;
+    }
+    cpu_relax();
+  }
+
+  __atomic_add_fetch(&sem->waiters, 1, __ATOMIC_SEQ_CST);
+  int success = 0;
+  while (!try_decrement(sem)) {
+    // Sleeps only if val is still 0
+    if (futex_wait(&sem->val, 0) == -1 && errno == EINTR) {
+      success = -1;
+      break;
+    }
+  }
+  __atomic_sub_fetch(&sem->waiters, 1, __ATOMIC_SEQ_CST);
+  return success;
 }
 
 /**
- * Post to a binary semaphore: increment its value by 1.
+ * Post to a semaphore: increment its value by 1.
  * This returns immediately.
+ *
+ * Only makes a system call when a process is asleep.
+ * 
+ * @param sem A pointer to the semaphore
+ * @return 0 on success.
+ */
+int sem_post(futex_sem* sem) {
+  __atomic_add_fetch(&sem->val, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&sem->waiters, __ATOMIC_SEQ_CST)) {
+    futex_wake(&sem->val, 1);
+  }
+  return 0;
+}
+
+/**
+ * Spinning only pays off when the process that
+ * will post is running on another core.
  * 
- * @param sem_id The semaphore's id
- * @return The return value of semop
+ * @return A spin count suited to this machine
  */
-int sem_post(int sem_id) {
-  struct sembuf operations[1];
-  /* Use the first (and only) semaphore. */
-  operations[0].sem_num = 0;
-  /* Increment by 1. */
-  operations[0].sem_op = 1;
-  /* Permit undo'ing. */
-  operations[0].sem_flg = SEM_UNDO;
-  return semop(sem_id, operations, 1);
-}
\ No newline at end of file
+unsigned int get_sem_spin() {
+  return sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SEM_DEFAULT_SPIN : 0;
+}
+
+/**
+ * Sleeps until woken, as long as the word at uaddr still equals val.
+ *
+ * @param uaddr A futex word in shared memory
+ * @param val   The value the caller last saw
+ * @return      0 if woken. -1 with errno set otherwise.
+ */
+int futex_wait(unsigned int* uaddr, unsigned int val) {
+  return futex(uaddr, FUTEX_WAIT, val, NULL);
+}
+
+/**
+ * Like futex_wait, but gives up after a while.
+ *
+ * @param uaddr            A futex word in shared memory
+ * @param val              The value the caller last saw
+ * @param timeout_nanosecs Longest time to sleep
+ * @return                 0 if woken. -1 with errno set otherwise.
+ */
+int futex_wait_timeout(unsigned int* uaddr,
+                       unsigned int val,
+                       long long timeout_nanosecs) {
+  struct timespec timeout;
+  timeout.tv_sec = timeout_nanosecs / 1000000000;
+  timeout.tv_nsec = timeout_nanosecs % 1000000000;
+  return futex(uaddr, FUTEX_WAIT, val, &timeout);
+}
+
+/**
+ * Wakes processes asleep on a futex word.
+ *
+ * @param uaddr       A futex word in shared memory
+ * @param num_to_wake Maximum number of processes to wake
+ * @return            The number of processes woken
+ */
+int futex_wake(unsigned int* uaddr, int num_to_wake) {
+  return futex(uaddr, FUTEX_WAKE, num_to_wake, NULL);
+}
+
+static int futex(unsigned int* uaddr,
+                 int op,
+                 unsigned int val,
+                 struct timespec* timeout) {
+  return syscall(SYS_futex, uaddr, op, val, timeout, NULL, 0);
+}
+
+/**
+ * @return 1 if the semaphore was positive and is now decremented.
+ */
+static int try_decrement(futex_sem* sem) {
+  unsigned int val = __atomic_load_n(&sem->val, __ATOMIC_SEQ_CST);
+  while (val > 0) {
+    if (__atomic_compare_exchange_n(&sem->val, &val, val - 1, 0,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+      return 1;
+    }
+  }
+  return 0;
+}
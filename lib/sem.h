@@ -1,19 +1,33 @@
 #ifndef SEM_H_
 #define SEM_H_
 
-#include <sys/sem.h>
+/*----------------------------------------------*
+ | A counting semaphore that lives in shared    |
+ | memory and sleeps on a Linux futex.          |
+ |                                              |
+ | Creating one is a store into memory that is  |
+ | already shared, so there is nothing to       |
+ | allocate or remove from the kernel.          |
+ *----------------------------------------------*/
+typedef struct futex_sem {
+  unsigned int val;      // Futex word. Number of available posts.
+  unsigned int waiters;  // Number of processes asleep on val
+  unsigned int spin;     // Times to retry before sleeping
+} futex_sem;
 
-union semun {
-  int val;                // Value for SETVAL
-  struct semid_ds *buf;   // Buffer for IPC_STAT, IPC_SET
-  unsigned short *array;  // Array for GETALL, SETALL
-  struct seminfo *__buf;  // Buffer for IPC_INFO (Linux-specific)
-};
+// Reasonable spin count when oss and user run on separate cores
+#define SEM_DEFAULT_SPIN 200
 
-int allocate_sem(key_t key, int sem_flags);
-int deallocate_sem(int sem_id);
-int init_sem(int sem_id, int initial_val);
-int sem_wait(int sem_id);
-int sem_post(int sem_id);
+void init_sem(futex_sem* sem, unsigned int initial_val, unsigned int spin);
+void deallocate_sem(futex_sem* sem);
+int sem_wait(futex_sem* sem);
+int sem_post(futex_sem* sem);
+unsigned int get_sem_spin();
 
-#endif
\ No newline at end of file
+int futex_wait(unsigned int* uaddr, unsigned int val);
+int futex_wait_timeout(unsigned int* uaddr,
+                       unsigned int val,
+                       long long timeout_nanosecs);
+int futex_wake(unsigned int* uaddr, int num_to_wake);
+
+#endif
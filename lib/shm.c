@@ -1,99 +1,135 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
-#include <sys/shm.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include "shm.h"
 
+static arena_t* map_new_arena(unsigned long long size, unsigned int flags, int* fd);
+static unsigned long long align_up(unsigned long long size, unsigned long long alignment);
+
 /**
- * Allocates shared memory for a simulated clock.
- * 
- * @return The shared memory segment ID
+ * Creates the shared memory arena, with each region after the
+ * header. With huge pages, it is backed by hugetlbfs if enough
+ * huge pages are reserved, and otherwise asks for transparent
+ * huge pages.
+ *
+ * @param  sizes          Size of each region (in bytes)
+ * @param  use_huge_pages Whether to back the arena with huge pages
+ * @param  fd             Set to the arena's file descriptor,
+ *                        which user processes inherit
+ * @return                A pointer to the arena
  */
-int get_clock_shm() {
-  int id = shmget(IPC_PRIVATE, sizeof(my_clock),
-    IPC_CREAT | IPC_EXCL | S_IRUSR | S_IWUSR);
+arena_t* create_arena(const unsigned long long* sizes, int use_huge_pages, int* fd) {
+  region_t regions[NUM_REGIONS];
+  unsigned long long size = align_up(sizeof(arena_t), ARENA_ALIGNMENT);
+  int i = 0;
+  for (; i < NUM_REGIONS; i++) {
+    regions[i].offset = size;
+    regions[i].size = sizes[i];
+    size = align_up(size + sizes[i], ARENA_ALIGNMENT);
+  }
 
-  if (id == -1) {
-    perror("Failed to get shared memory for clock");
-    exit(EXIT_FAILURE);
+  arena_t* arena = NULL;
+  if (use_huge_pages) {
+    size = align_up(size, ARENA_HUGE_PAGE_SIZE);
+    arena = map_new_arena(size, MFD_HUGETLB, fd);
   }
-  return id;
+  int is_huge = arena != NULL;
+  if (arena == NULL) {
+    arena = map_new_arena(size, 0, fd);
+    if (arena == NULL) {
+      perror("Failed to create shared memory");
+      exit(EXIT_FAILURE);
+    }
+    if (use_huge_pages) {
+      madvise(arena, size, MADV_HUGEPAGE);
+    }
+  }
+
+  arena->magic = ARENA_MAGIC;
+  arena->version = ARENA_VERSION;
+  arena->size = size;
+  arena->is_huge = is_huge;
+  for (i = 0; i < NUM_REGIONS; i++) {
+    arena->regions[i] = regions[i];
+  }
+  return arena;
 }
 
 /**
- * Attaches to the clock shared memory segment.
- * 
- * @return A pointer to the clock in shared memory.
+ * Maps the arena a file descriptor refers to, in one mapping.
+ * Exits the program if it is not an arena of this version.
+ *
+ * @param  fd The arena's file descriptor
+ * @return    A pointer to the arena
  */
-my_clock* attach_to_clock_shm(int id) {
-  void* clock_shm = shmat(id, NULL, 0);
-
-  if (*((int*) clock_shm) == -1) {
-    perror("Failed to attach to clock shared memory");
+arena_t* attach_to_arena(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    perror("Failed to find shared memory");
     exit(EXIT_FAILURE);
   }
-
-  return (my_clock*) clock_shm;
+  arena_t* arena = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (arena == MAP_FAILED) {
+    perror("Failed to attach to shared memory");
+    exit(EXIT_FAILURE);
+  }
+  if (arena->magic != ARENA_MAGIC || arena->version != ARENA_VERSION) {
+    fprintf(stderr, "Shared memory is not an arena of version %d\n", ARENA_VERSION);
+    exit(EXIT_FAILURE);
+  }
+  return arena;
 }
 
 /**
- * Detaches from clock shared memory.
- * 
- * @param Clock shared memory
- * @return On success, 0. On error -1.
+ * Unmaps the arena.
+ *
+ * @param  arena A pointer to the arena
+ * @return       On success, 0. On error -1.
  */
-int detach_from_clock_shm(my_clock* shm) {
-  int success = shmdt(shm);
+int detach_from_arena(arena_t* arena) {
+  int success = munmap(arena, arena->size);
   if (success == -1) {
-    perror("Failed to detach from clock shared memory");
+    perror("Failed to detach from shared memory");
   }
   return success;
 }
 
 /**
- * Allocates shared memory for storing information
- * regarding memory operations for various processes.
- *
- * @param The number of processes
- * @return The shared memory segment ID
+ * @param  arena  A pointer to the arena
+ * @param  region Which region
+ * @return        A pointer to the region
  */
-int get_mem_ops(int num_procs) {
-  int id = shmget(IPC_PRIVATE, sizeof(mem_op_t) * num_procs,
-    IPC_CREAT | IPC_EXCL | S_IRUSR | S_IWUSR);
-
-  if (id == -1) {
-    perror("Failed to get shared memory for memory operations");
-    exit(EXIT_FAILURE);
-  }
-  return id;
+void* get_region(arena_t* arena, arena_region region) {
+  return (char*) arena + arena->regions[region].offset;
 }
 
 /**
- * Attaches to the shared memory for memory operations.
- * 
- * @return A pointer to the shared memory.
+ * Creates a memfd of a size and maps it.
+ *
+ * @param  size  Size of the arena (in bytes)
+ * @param  flags Flags for memfd_create
+ * @param  fd    Set to the memfd
+ * @return       A pointer to the mapping, or NULL if it failed
  */
-mem_op_t* attach_to_mem_ops(int id) {
-  void* mem_ops = shmat(id, NULL, 0);
-
-  if (*((int*) mem_ops) == -1) {
-    perror("Failed to attach to shared memory for memory operations");
-    exit(EXIT_FAILURE);
+static arena_t* map_new_arena(unsigned long long size, unsigned int flags, int* fd) {
+  *fd = memfd_create("oss", flags);
+  if (*fd == -1) {
+    return NULL;
   }
-
-  return (mem_op_t*) mem_ops;
+  void* arena = MAP_FAILED;
+  if (ftruncate(*fd, size) == 0) {
+    arena = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+  }
+  if (arena == MAP_FAILED) {
+    close(*fd);
+    return NULL;
+  }
+  return arena;
 }
 
-/**
- * Detaches from shared memory for memory operations.
- * 
- * @param A pointer to the shared memory.
- * @return On success, 0. On error -1.
- */
-int detach_from_mem_ops(mem_op_t* shm) {
-  int success = shmdt(shm);
-  if (success == -1) {
-    perror("Failed to detach from shared memory for memory operations");
-  }
-  return success;
-}
\ No newline at end of file
+static unsigned long long align_up(unsigned long long size, unsigned long long alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
@@ -2,18 +2,62 @@
 #define SHM_H_
 
 #include "myclock.h"
+#include "sem.h"
 #include "pagetable.h"
+#include "ring.h"
 
 /*------------------------------------------*
  | Operating System Simulator Shared Memory |
  *------------------------------------------*/
 
-int get_clock_shm();
-my_clock* attach_to_clock_shm(int id);
-int detach_from_clock_shm(my_clock* shm);
+typedef struct clock_shm_t {
+  my_clock clock;  // Advanced atomically, so it needs no lock
+} clock_shm_t;
 
-int get_mem_ops(int num_procs);
-mem_op_t* attach_to_mem_ops(int id);
-int detach_from_mem_ops(mem_op_t* shm);
+// Identifies an arena, and the version of the header's layout
+#define ARENA_MAGIC 0x4f535341
+#define ARENA_VERSION 1
+
+// Regions start on a page, and huge-page arenas are a whole
+// number of huge pages (in bytes)
+#define ARENA_ALIGNMENT 4096
+#define ARENA_HUGE_PAGE_SIZE (2ULL << 20)
+
+typedef enum {
+  CLOCK_REGION,
+  PAGE_TABLES_REGION,
+  MEM_RINGS_REGION,
+  NUM_REGIONS
+} arena_region;
+
+/**
+ * Where a region lives in an arena (in bytes)
+ */
+typedef struct region_t {
+  unsigned long long offset;  // From the start of the arena
+  unsigned long long size;
+} region_t;
+
+/*---------------------------------------------------*
+ | All of the simulator's shared memory, in a memfd  |
+ | that oss and every user process map once. This    |
+ | header starts the arena and says where each       |
+ | region lives, so a process only needs the file    |
+ | descriptor. Pages are only allocated once they    |
+ | are touched, and the memory is freed once the     |
+ | last process holding it exits, however it exits.  |
+ *---------------------------------------------------*/
+typedef struct arena_t {
+  unsigned int magic;
+  unsigned int version;
+  unsigned long long size;  // Of the whole arena (in bytes)
+  int is_huge;              // Backed by hugetlbfs
+  region_t regions[NUM_REGIONS];
+} arena_t;
+
+arena_t* create_arena(const unsigned long long* sizes, int use_huge_pages, int* fd);
+arena_t* attach_to_arena(int fd);
+int detach_from_arena(arena_t* arena);
+void* get_region(arena_t* arena, arena_region region);
 
 #endif
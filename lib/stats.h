@@ -1,13 +1,50 @@
 #ifndef STATS_H_
 #define STATS_H_
 
+#include "lib/histogram.h"
 #include "lib/myclock.h"
 
 typedef struct stats_t {
   unsigned int num_mem_accesses;
   unsigned int num_page_faults;
-  my_clock start_time;
-  my_clock end_time;
+  unsigned int num_evictions;
+  unsigned int num_tlb_hits;
+  unsigned int num_writebacks;        // Dirty pages evicted
+  unsigned long long fault_nanosecs;  // Simulated time spent on page faults
+  unsigned int num_readaheads;         // Pages read ahead of a fault
+  unsigned int num_readahead_hits;     // Of those, pages used
+  unsigned int num_readaheads_wasted;  // Of those, pages evicted unused
+  unsigned int num_huge_faults;    // Faults that loaded a whole huge page
+  unsigned int num_huge_tlb_hits;  // TLB hits on huge pages
+  unsigned int num_promotions;     // Regions promoted to huge pages
+  unsigned int num_demotions;      // Huge pages split to evict a page
+  unsigned long long base_tlb_reach;  // Bytes the TLBs mapped at exit
+  unsigned long long huge_tlb_reach;
+  int has_tlb_reach;                  // Whether the reach was recorded
+  unsigned long long start_time;  // Simulated (ns)
+  unsigned long long end_time;
+  histogram_t sim_latency;   // Simulated time from request to completion (ns)
+  histogram_t real_latency;  // Wall clock time from request to completion (ns)
 } stats_t;
 
+/**
+ * Sums of many processes' stats, for the page replacement report
+ */
+typedef struct stats_totals_t {
+  unsigned long long num_tlb_reaches;  // Processes whose reach was recorded
+  unsigned long long mem_accesses;
+  unsigned long long page_faults;
+  unsigned long long evictions;
+  unsigned long long tlb_hits;
+  unsigned long long huge_faults;
+  unsigned long long readaheads;
+  unsigned long long readahead_hits;
+  unsigned long long readaheads_wasted;
+  unsigned long long huge_tlb_hits;
+  unsigned long long promotions;
+  unsigned long long demotions;
+  unsigned long long base_tlb_reach;
+  unsigned long long huge_tlb_reach;
+} stats_totals_t;
+
 #endif
\ No newline at end of file
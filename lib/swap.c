@@ -0,0 +1,257 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "swap.h"
+
+static unsigned long long submit_request(swap_device_t* swap,
+                                         long long block,
+                                         int num_pages,
+                                         unsigned long long now,
+                                         unsigned long long* stall);
+static void retire_requests(swap_device_t* swap, unsigned long long now);
+static void sort_blocks(long long* blocks, int num_blocks);
+
+/**
+ * Sets up an idle device with an empty writeback buffer.
+ *
+ * @param swap        The device
+ * @param page_size   Page size (in bytes)
+ * @param queue_depth Most requests waiting or in service
+ * @param batch_size  Dirty pages gathered before they are written
+ */
+void init_swap_device(swap_device_t* swap,
+                      unsigned int page_size,
+                      int queue_depth,
+                      int batch_size) {
+  swap->transfer_nanosecs =
+    (unsigned long long) page_size * NANOSECS_PER_MILLISEC / SWAP_BYTES_PER_MILLISEC;
+  swap->queue_depth = queue_depth;
+  swap->batch_size = batch_size;
+  swap->busy_until = 0;
+  swap->next_block = -1;
+  swap->first_completion = 0;
+  swap->num_in_flight = 0;
+  swap->num_writeback = 0;
+  swap->completions = malloc(sizeof(unsigned long long) * queue_depth);
+  swap->writeback = malloc(sizeof(long long) * batch_size);
+  if (swap->completions == NULL || swap->writeback == NULL) {
+    perror("Failed to allocate swap device");
+    exit(EXIT_FAILURE);
+  }
+  swap->stats = (swap_stats_t) { 0 };
+}
+
+void destroy_swap_device(swap_device_t* swap) {
+  free(swap->completions);
+  free(swap->writeback);
+}
+
+/**
+ * Reads pages in, after every request already queued.
+ *
+ * @param  swap      The device
+ * @param  block     First block
+ * @param  num_pages Number of adjacent blocks
+ * @param  now       Simulated time of the read (in nanoseconds)
+ * @return           Nanoseconds until the pages are in memory
+ */
+unsigned long long swap_read(swap_device_t* swap,
+                             long long block,
+                             int num_pages,
+                             unsigned long long now) {
+  unsigned long long stall;
+  unsigned long long done = submit_request(swap, block, num_pages, now, &stall);
+  swap->stats.reads++;
+  swap->stats.pages_read += num_pages;
+  swap->stats.read_nanosecs += done - now;
+  return done - now;
+}
+
+/**
+ * Reads pages in that no request is waiting for yet, after
+ * every request already queued. Its time is its own, but it
+ * delays whatever is queued after it.
+ *
+ * @param  swap      The device
+ * @param  block     First block
+ * @param  num_pages Number of adjacent blocks
+ * @param  now       Simulated time of the read (in nanoseconds)
+ * @return           Simulated time the pages are in memory
+ */
+unsigned long long swap_read_ahead(swap_device_t* swap,
+                                   long long block,
+                                   int num_pages,
+                                   unsigned long long now) {
+  unsigned long long stall;
+  swap->stats.readaheads++;
+  swap->stats.pages_read_ahead += num_pages;
+  return submit_request(swap, block, num_pages, now, &stall);
+}
+
+/**
+ * @param  swap The device
+ * @param  now  Simulated time (in nanoseconds)
+ * @return      1 if every queue slot is taken, so reading
+ *              ahead would only hold up other requests.
+ *              0 otherwise.
+ */
+int is_swap_congested(swap_device_t* swap, unsigned long long now) {
+  retire_requests(swap, now);
+  return swap->num_in_flight == swap->queue_depth;
+}
+
+/**
+ * Adds an evicted dirty page to the writeback buffer,
+ * and writes the buffer back if it is full.
+ *
+ * @param  swap  The device
+ * @param  block The page's block
+ * @param  now   Simulated time of the eviction (in nanoseconds)
+ * @return       Nanoseconds the eviction waited for the device
+ *               to take the writes
+ */
+unsigned long long swap_write(swap_device_t* swap,
+                              long long block,
+                              unsigned long long now) {
+  swap->writeback[swap->num_writeback++] = block;
+  if (swap->num_writeback < swap->batch_size) {
+    return 0;
+  }
+  return flush_writeback(swap, now);
+}
+
+/**
+ * Writes back every buffered page, in block order,
+ * as one request per run of adjacent blocks.
+ * The writes complete in the background.
+ *
+ * @param  swap The device
+ * @param  now  Simulated time (in nanoseconds)
+ * @return      Nanoseconds spent waiting for free queue slots
+ */
+unsigned long long flush_writeback(swap_device_t* swap, unsigned long long now) {
+  sort_blocks(swap->writeback, swap->num_writeback);
+  unsigned long long total_stall = 0;
+  int first = 0;
+  while (first < swap->num_writeback) {
+    int end = first + 1;
+    while (end < swap->num_writeback &&
+           swap->writeback[end] <= swap->writeback[end - 1] + 1) {
+      end++;
+    }
+    // A page evicted twice before the flush is written once
+    int num_pages = swap->writeback[end - 1] - swap->writeback[first] + 1;
+    unsigned long long stall;
+    submit_request(swap, swap->writeback[first], num_pages, now, &stall);
+    now += stall;
+    total_stall += stall;
+    swap->stats.writes++;
+    swap->stats.pages_written += num_pages;
+    first = end;
+  }
+  swap->num_writeback = 0;
+  swap->stats.stall_nanosecs += total_stall;
+  return total_stall;
+}
+
+/**
+ * Takes a page back out of the writeback buffer, for a fault
+ * on a page that has not been written yet. It needs no read.
+ *
+ * @param  swap  The device
+ * @param  block The page's block
+ * @return       1 if the page was in the buffer. 0 otherwise.
+ */
+int reclaim_writeback(swap_device_t* swap, long long block) {
+  int i = 0;
+  for (; i < swap->num_writeback; i++) {
+    if (swap->writeback[i] == block) {
+      swap->writeback[i] = swap->writeback[--swap->num_writeback];
+      swap->stats.buffer_hits++;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void merge_swap_stats(swap_stats_t* dest, const swap_stats_t* src) {
+  dest->reads += src->reads;
+  dest->pages_read += src->pages_read;
+  dest->read_nanosecs += src->read_nanosecs;
+  dest->readaheads += src->readaheads;
+  dest->pages_read_ahead += src->pages_read_ahead;
+  dest->writes += src->writes;
+  dest->pages_written += src->pages_written;
+  dest->stall_nanosecs += src->stall_nanosecs;
+  dest->buffer_hits += src->buffer_hits;
+}
+
+/**
+ * Queues a request behind every other. When the queue is full,
+ * the submitter first waits for the oldest request to complete.
+ *
+ * @param  swap      The device
+ * @param  block     First block
+ * @param  num_pages Number of adjacent blocks
+ * @param  now       Simulated time of submission (in nanoseconds)
+ * @param  stall     Set to how long the submitter waited for a slot
+ * @return           Simulated time the request completes
+ */
+static unsigned long long submit_request(swap_device_t* swap,
+                                         long long block,
+                                         int num_pages,
+                                         unsigned long long now,
+                                         unsigned long long* stall) {
+  retire_requests(swap, now);
+  *stall = 0;
+  if (swap->num_in_flight == swap->queue_depth) {
+    unsigned long long oldest = swap->completions[swap->first_completion];
+    *stall = oldest - now;
+    now = oldest;
+    retire_requests(swap, now);
+  }
+
+  unsigned long long start = swap->busy_until > now ? swap->busy_until : now;
+  unsigned long long cost = num_pages * swap->transfer_nanosecs;
+  if (block != swap->next_block) {
+    cost += SWAP_SEEK_NANOSECS;
+  }
+  swap->busy_until = start + cost;
+  swap->next_block = block + num_pages;
+
+  int slot = swap->first_completion + swap->num_in_flight;
+  if (slot >= swap->queue_depth) {
+    slot -= swap->queue_depth;
+  }
+  swap->completions[slot] = swap->busy_until;
+  swap->num_in_flight++;
+  return swap->busy_until;
+}
+
+/**
+ * Removes requests that have completed by a time.
+ */
+static void retire_requests(swap_device_t* swap, unsigned long long now) {
+  while (swap->num_in_flight > 0 &&
+         swap->completions[swap->first_completion] <= now) {
+    if (++swap->first_completion == swap->queue_depth) {
+      swap->first_completion = 0;
+    }
+    swap->num_in_flight--;
+  }
+}
+
+/**
+ * Insertion sort, since a batch is small and
+ * evictions often come in nearly sorted order.
+ */
+static void sort_blocks(long long* blocks, int num_blocks) {
+  int i = 1;
+  for (; i < num_blocks; i++) {
+    long long block = blocks[i];
+    int j = i;
+    for (; j > 0 && blocks[j - 1] > block; j--) {
+      blocks[j] = blocks[j - 1];
+    }
+    blocks[j] = block;
+  }
+}
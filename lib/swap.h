@@ -0,0 +1,84 @@
+#ifndef SWAP_H_
+#define SWAP_H_
+
+#include "myclock.h"
+
+/*--------------------------------------*
+ | Backing store cost model. A random   |
+ | read of a default 1000 byte page     |
+ | takes 15 ms, as every page fault     |
+ | used to.                             |
+ *--------------------------------------*/
+#define SWAP_SEEK_NANOSECS (14 * NANOSECS_PER_MILLISEC)
+#define SWAP_BYTES_PER_MILLISEC 1000
+
+// Pages of dirty evictions written together, and requests in flight
+#define DEFAULT_WRITEBACK_BATCH 16
+#define DEFAULT_SWAP_QUEUE_DEPTH 32
+#define MAX_WRITEBACK_BATCH 1024
+#define MAX_SWAP_QUEUE_DEPTH 1024
+
+/**
+ * What a swap device has done
+ */
+typedef struct swap_stats_t {
+  unsigned long long reads;            // Read requests
+  unsigned long long pages_read;
+  unsigned long long read_nanosecs;    // From submission to completion
+  unsigned long long readaheads;       // Read requests nothing waited on
+  unsigned long long pages_read_ahead;
+  unsigned long long writes;           // Write requests, after coalescing
+  unsigned long long pages_written;
+  unsigned long long stall_nanosecs;   // Waiting for a free queue slot
+  unsigned long long buffer_hits;      // Faults on pages still to be written
+} swap_stats_t;
+
+/*---------------------------------------------------*
+ | A simulated disk that serves one request at a    |
+ | time, in order, with at most queue_depth waiting  |
+ | or in service. A request costs a seek unless it   |
+ | starts where the last one ended, plus a transfer  |
+ | per page. Pages are stored in blocks, one per     |
+ | page of every process.                            |
+ |                                                   |
+ | Dirty pages are written back asynchronously. They |
+ | wait in a buffer until batch_size have gathered,  |
+ | then go out sorted, with runs of adjacent blocks  |
+ | coalesced into one request each.                  |
+ *---------------------------------------------------*/
+typedef struct swap_device_t {
+  unsigned long long transfer_nanosecs;  // Per page
+  int queue_depth;
+  int batch_size;
+  unsigned long long busy_until;  // Simulated time the last request completes
+  long long next_block;           // Block after the last one transferred
+  unsigned long long* completions;  // Of requests in flight, oldest first
+  int first_completion;
+  int num_in_flight;
+  long long* writeback;  // Blocks waiting to be written
+  int num_writeback;
+  swap_stats_t stats;
+} swap_device_t;
+
+void init_swap_device(swap_device_t* swap,
+                      unsigned int page_size,
+                      int queue_depth,
+                      int batch_size);
+void destroy_swap_device(swap_device_t* swap);
+unsigned long long swap_read(swap_device_t* swap,
+                             long long block,
+                             int num_pages,
+                             unsigned long long now);
+unsigned long long swap_read_ahead(swap_device_t* swap,
+                                   long long block,
+                                   int num_pages,
+                                   unsigned long long now);
+int is_swap_congested(swap_device_t* swap, unsigned long long now);
+unsigned long long swap_write(swap_device_t* swap,
+                              long long block,
+                              unsigned long long now);
+unsigned long long flush_writeback(swap_device_t* swap, unsigned long long now);
+int reclaim_writeback(swap_device_t* swap, long long block);
+void merge_swap_stats(swap_stats_t* dest, const swap_stats_t* src);
+
+#endif
@@ -0,0 +1,169 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "tlb.h"
+
+typedef struct tlb_entry_t {
+  long long page_num;
+  page* pg;  // NULL if the entry is empty, whatever its page_num
+} tlb_entry_t;
+
+struct tlb_t {
+  tlb_policy policy;
+  int num_ways;
+  int set_mask;  // Number of sets - 1
+  tlb_entry_t entries[];
+};
+
+static const char* tlb_policy_names[NUM_TLB_POLICIES] = {
+  "lru", "fifo"
+};
+
+static tlb_entry_t* get_set(tlb_t* tlb, long long page_num);
+
+/**
+ * @param num_entries Entries across every set
+ * @param num_ways    Entries per set
+ * @param policy      Which entry of a full set to replace
+ * @return            An empty TLB. Check is_valid_tlb_geometry first.
+ */
+tlb_t* create_tlb(int num_entries, int num_ways, tlb_policy policy) {
+  tlb_t* tlb = malloc(sizeof(tlb_t) + sizeof(tlb_entry_t) * num_entries);
+  if (tlb == NULL) {
+    perror("Failed to allocate TLB");
+    exit(EXIT_FAILURE);
+  }
+  tlb->policy = policy;
+  tlb->num_ways = num_ways;
+  tlb->set_mask = num_entries / num_ways - 1;
+  tlb_flush(tlb);
+  return tlb;
+}
+
+void destroy_tlb(tlb_t* tlb) {
+  free(tlb);
+}
+
+/**
+ * Translates a page. With LRU a hit becomes the
+ * most recently used entry of its set.
+ *
+ * @param tlb      The TLB
+ * @param page_num The page
+ * @return         Its page table entry, or NULL on a miss
+ */
+page* tlb_lookup(tlb_t* tlb, long long page_num) {
+  tlb_entry_t* set = get_set(tlb, page_num);
+  int i = 0;
+  for (; i < tlb->num_ways; i++) {
+    if (set[i].pg != NULL && set[i].page_num == page_num) {
+      tlb_entry_t hit = set[i];
+      if (tlb->policy == TLB_LRU) {
+        for (; i > 0; i--) set[i] = set[i - 1];
+        set[0] = hit;
+      }
+      return hit.pg;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Adds a translation that missed, replacing the
+ * least recently used or oldest entry of its set.
+ *
+ * @param tlb      The TLB
+ * @param page_num The page
+ * @param pg       Its page table entry, which must be valid
+ */
+void tlb_insert(tlb_t* tlb, long long page_num, page* pg) {
+  tlb_entry_t* set = get_set(tlb, page_num);
+  int i = tlb->num_ways - 1;
+  for (; i > 0; i--) set[i] = set[i - 1];
+  set[0].page_num = page_num;
+  set[0].pg = pg;
+}
+
+/**
+ * Removes a page's translation, if there is one.
+ * Must be called whenever the page leaves its frame.
+ *
+ * @param tlb      The TLB
+ * @param page_num The page
+ */
+void tlb_invalidate(tlb_t* tlb, long long page_num) {
+  tlb_entry_t* set = get_set(tlb, page_num);
+  int i = 0;
+  for (; i < tlb->num_ways; i++) {
+    if (set[i].pg != NULL && set[i].page_num == page_num) {
+      for (; i < tlb->num_ways - 1; i++) set[i] = set[i + 1];
+      set[i].pg = NULL;
+      return;
+    }
+  }
+}
+
+/**
+ * Removes every translation.
+ */
+void tlb_flush(tlb_t* tlb) {
+  int num_entries = (tlb->set_mask + 1) * tlb->num_ways;
+  int i = 0;
+  for (; i < num_entries; i++) {
+    tlb->entries[i].pg = NULL;
+  }
+}
+
+/**
+ * @return Entries holding a translation, so with the size of
+ *         the pages they map, how much memory the TLB reaches
+ */
+int count_tlb_entries(tlb_t* tlb) {
+  int num_entries = (tlb->set_mask + 1) * tlb->num_ways;
+  int count = 0;
+  int i = 0;
+  for (; i < num_entries; i++) {
+    count += tlb->entries[i].pg != NULL;
+  }
+  return count;
+}
+
+/**
+ * @param num_entries Entries across every set
+ * @param num_ways    Entries per set
+ * @return            1 if the ways divide the entries into
+ *                    a power of two number of sets, otherwise 0
+ */
+int is_valid_tlb_geometry(int num_entries, int num_ways) {
+  if (num_entries <= 0 || num_ways <= 0 || num_entries % num_ways != 0) {
+    return 0;
+  }
+  int num_sets = num_entries / num_ways;
+  return (num_sets & (num_sets - 1)) == 0;
+}
+
+const char* get_tlb_policy_name(tlb_policy policy) {
+  return tlb_policy_names[policy];
+}
+
+/**
+ * @param  name A policy name such as "lru"
+ * @return      The matching tlb_policy, or -1 if there is none
+ */
+int parse_tlb_policy_name(const char* name) {
+  int i = 0;
+  for (; i < NUM_TLB_POLICIES; i++) {
+    if (strcmp(name, tlb_policy_names[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Pages are spread across sets by their low bits,
+ * so consecutive pages land in different sets.
+ */
+static tlb_entry_t* get_set(tlb_t* tlb, long long page_num) {
+  return tlb->entries + (page_num & tlb->set_mask) * tlb->num_ways;
+}
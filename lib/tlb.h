@@ -0,0 +1,31 @@
+#ifndef TLB_H_
+#define TLB_H_
+
+#include "pagetable.h"
+
+/*-----------------------------*
+ | TLB Replacement Policies    |
+ *-----------------------------*/
+typedef enum { TLB_LRU, TLB_FIFO, NUM_TLB_POLICIES } tlb_policy;
+
+/**
+ * A set associative cache of one process' translations from
+ * page numbers to page table entries, so a hit needs no walk
+ * of the page table. Each set holds num_ways entries, ordered
+ * from most to least recently used or inserted, so a
+ * lookup only scans a few adjacent entries.
+ */
+typedef struct tlb_t tlb_t;
+
+tlb_t* create_tlb(int num_entries, int num_ways, tlb_policy policy);
+void destroy_tlb(tlb_t* tlb);
+page* tlb_lookup(tlb_t* tlb, long long page_num);
+void tlb_insert(tlb_t* tlb, long long page_num, page* pg);
+void tlb_invalidate(tlb_t* tlb, long long page_num);
+void tlb_flush(tlb_t* tlb);
+int count_tlb_entries(tlb_t* tlb);
+int is_valid_tlb_geometry(int num_entries, int num_ways);
+const char* get_tlb_policy_name(tlb_policy policy);
+int parse_tlb_policy_name(const char* name);
+
+#endif
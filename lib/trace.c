@@ -0,0 +1,271 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "trace.h"
+
+// Flush the write buffer when it gets this full
+#define TRACE_BUF_SIZE (1 << 16)
+
+// Longest encoding of a record: three 64-bit varints
+#define MAX_RECORD_SIZE 30
+
+static unsigned char* put_varint(unsigned char* p, unsigned long long val);
+static int get_varint(trace_reader_t* reader, unsigned long long* val);
+static unsigned long long zigzag(long long val);
+static long long unzigzag(unsigned long long val);
+static void flush_trace_writer(trace_writer_t* writer);
+static void fill_trace_header(trace_header_t* header,
+                              int max_procs,
+                              unsigned long long num_records);
+
+/**
+ * Creates a trace file for recording.
+ * 
+ * @param  writer    A pointer to the writer to set up
+ * @param  path      Path of the trace file
+ * @param  max_procs Maximum number of processes
+ * @return           0 on success. -1 on error.
+ */
+int open_trace_writer(trace_writer_t* writer, const char* path, int max_procs) {
+  writer->file = fopen(path, "wb");
+  if (writer->file == NULL) {
+    perror("Failed to open trace file for writing");
+    return -1;
+  }
+  writer->buf = malloc(TRACE_BUF_SIZE);
+  writer->prev_addr = calloc(max_procs, sizeof(unsigned long long));
+  if (writer->buf == NULL || writer->prev_addr == NULL) {
+    perror("Failed to allocate trace buffer");
+    fclose(writer->file);
+    return -1;
+  }
+  writer->len = 0;
+  writer->max_procs = max_procs;
+  writer->prev_pid = 0;
+  writer->prev_time = 0;
+  writer->num_records = 0;
+
+  trace_header_t header;
+  fill_trace_header(&header, max_procs, 0);
+  fwrite(&header, sizeof(header), 1, writer->file);
+  return 0;
+}
+
+/**
+ * Appends a record to the trace.
+ * Makes a system call only when the buffer fills.
+ * 
+ * @param writer A pointer to the writer
+ * @param record The record
+ */
+void write_trace_record(trace_writer_t* writer, trace_record_t* record) {
+  if (writer->len > TRACE_BUF_SIZE - MAX_RECORD_SIZE) {
+    flush_trace_writer(writer);
+  }
+  unsigned char* p = writer->buf + writer->len;
+
+  unsigned long long pid_delta = zigzag((long long) record->pid - writer->prev_pid);
+  p = put_varint(p, pid_delta << 2 | record->kind);
+  p = put_varint(p, zigzag((long long) (record->time - writer->prev_time)));
+  if (record->kind != TRACE_EXIT) {
+    unsigned long long* prev_addr = writer->prev_addr + record->pid;
+    p = put_varint(p, zigzag((long long) (record->addr - *prev_addr)));
+    *prev_addr = record->addr;
+  }
+
+  writer->prev_pid = record->pid;
+  writer->prev_time = record->time;
+  writer->len = p - writer->buf;
+  writer->num_records++;
+}
+
+/**
+ * Flushes the trace, records the number of records
+ * in its header and closes it.
+ * 
+ * @param  writer A pointer to the writer
+ * @return        0 on success. -1 on error.
+ */
+int close_trace_writer(trace_writer_t* writer) {
+  flush_trace_writer(writer);
+  trace_header_t header;
+  fill_trace_header(&header, writer->max_procs, writer->num_records);
+  int success = 0;
+  if (fseek(writer->file, 0, SEEK_SET) == -1 ||
+      fwrite(&header, sizeof(header), 1, writer->file) != 1) {
+    perror("Failed to finish trace file");
+    success = -1;
+  }
+  if (fclose(writer->file) == EOF) {
+    perror("Failed to close trace file");
+    success = -1;
+  }
+  free(writer->buf);
+  free(writer->prev_addr);
+  return success;
+}
+
+/**
+ * Maps a trace file into memory for replay.
+ * 
+ * @param  reader A pointer to the reader to set up
+ * @param  path   Path of the trace file
+ * @return        0 on success. -1 on error.
+ */
+int open_trace_reader(trace_reader_t* reader, const char* path) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    perror("Failed to open trace file for reading");
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(trace_header_t)) {
+    fprintf(stderr, "Trace file is too short\n");
+    close(fd);
+    return -1;
+  }
+  reader->size = st.st_size;
+  reader->map = mmap(NULL, reader->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (reader->map == MAP_FAILED) {
+    perror("Failed to map trace file");
+    return -1;
+  }
+  madvise(reader->map, reader->size, MADV_SEQUENTIAL);
+
+  trace_header_t* header = &reader->header;
+  memcpy(header, reader->map, sizeof(*header));
+  if (header->magic != TRACE_MAGIC || header->version != TRACE_VERSION) {
+    fprintf(stderr, "Not a trace file or unsupported version\n");
+    munmap(reader->map, reader->size);
+    return -1;
+  }
+
+  reader->max_procs = header->max_procs;
+  reader->prev_addr = calloc(header->max_procs, sizeof(unsigned long long));
+  if (reader->prev_addr == NULL) {
+    perror("Failed to allocate trace reader");
+    munmap(reader->map, reader->size);
+    return -1;
+  }
+  reader->pos = reader->map + sizeof(*header);
+  reader->end = reader->map + reader->size;
+  reader->prev_pid = 0;
+  reader->prev_time = 0;
+  return 0;
+}
+
+/**
+ * Decodes the next record.
+ * 
+ * @param  reader A pointer to the reader
+ * @param  record Set to the record
+ * @return        1 if a record was read. 0 at the end of the trace.
+ *                -1 if the trace is corrupt or an address is
+ *                outside the recorded address space.
+ */
+int read_trace_record(trace_reader_t* reader, trace_record_t* record) {
+  if (reader->pos == reader->end) {
+    return 0;
+  }
+  unsigned long long val;
+  if (!get_varint(reader, &val)) return -1;
+  int pid = reader->prev_pid + (int) unzigzag(val >> 2);
+  trace_kind kind = val & 3;
+  if (pid < 0 || pid >= reader->max_procs || kind > TRACE_EXIT) return -1;
+
+  if (!get_varint(reader, &val)) return -1;
+  reader->prev_time += unzigzag(val);
+
+  record->pid = pid;
+  record->kind = kind;
+  record->time = reader->prev_time;
+  if (kind != TRACE_EXIT) {
+    if (!get_varint(reader, &val)) return -1;
+    unsigned long long* prev_addr = reader->prev_addr + pid;
+    *prev_addr += (unsigned long long) unzigzag(val);
+    if (*prev_addr >= reader->header.proc_mem) return -1;
+    record->addr = *prev_addr;
+  }
+  reader->prev_pid = pid;
+  return 1;
+}
+
+void close_trace_reader(trace_reader_t* reader) {
+  munmap(reader->map, reader->size);
+  free(reader->prev_addr);
+}
+
+/**
+ * Describes a trace recorded in the current geometry.
+ *
+ * @param header      Set to the header
+ * @param max_procs   Maximum number of processes
+ * @param num_records Records in the trace, or 0 until it is finished
+ */
+static void fill_trace_header(trace_header_t* header,
+                              int max_procs,
+                              unsigned long long num_records) {
+  memset(header, 0, sizeof(*header));
+  header->magic = TRACE_MAGIC;
+  header->version = TRACE_VERSION;
+  header->max_procs = max_procs;
+  header->num_records = num_records;
+  header->proc_mem = geometry.proc_mem;
+  header->page_size = geometry.page_size;
+  header->num_levels = geometry.num_levels;
+  memcpy(header->level_bits, geometry.level_bits, sizeof(header->level_bits));
+  header->huge_page_pages = geometry.huge_page_pages;
+}
+
+static void flush_trace_writer(trace_writer_t* writer) {
+  if (writer->len > 0 &&
+      fwrite(writer->buf, 1, writer->len, writer->file) != writer->len) {
+    perror("Failed to write trace file");
+  }
+  writer->len = 0;
+}
+
+static unsigned char* put_varint(unsigned char* p, unsigned long long val) {
+  while (val >= 0x80) {
+    *p++ = (unsigned char) (val | 0x80);
+    val >>= 7;
+  }
+  *p++ = (unsigned char) val;
+  return p;
+}
+
+/**
+ * @return 1 on success. 0 if the varint runs past the end of the trace.
+ */
+static int get_varint(trace_reader_t* reader, unsigned long long* val) {
+  const unsigned char* p = reader->pos;
+  unsigned long long result = 0;
+  int shift = 0;
+  while (p < reader->end && shift < 64) {
+    unsigned char byte = *p++;
+    result |= (unsigned long long) (byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      reader->pos = p;
+      *val = result;
+      return 1;
+    }
+    shift += 7;
+  }
+  return 0;
+}
+
+/**
+ * Maps signed values to unsigned ones so small
+ * magnitudes of either sign encode in few bytes.
+ */
+static unsigned long long zigzag(long long val) {
+  return ((unsigned long long) val << 1) ^ (unsigned long long) (val >> 63);
+}
+
+static long long unzigzag(unsigned long long val) {
+  return (long long) (val >> 1) ^ -(long long) (val & 1);
+}
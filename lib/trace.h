@@ -0,0 +1,77 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stddef.h>
+#include <stdio.h>
+#include "pagetable.h"
+
+// "MMTRACE" in a little-endian word
+#define TRACE_MAGIC 0x45434152544d4dULL
+#define TRACE_VERSION 2
+
+/*----------------------------------------------------*
+ | Binary Trace Format                                |
+ |                                                    |
+ | A trace_header_t followed by one record per event. |
+ | Each field of a record is a LEB128 varint:         |
+ |   1. zigzag(pid - previous pid) << 2 | kind        |
+ |   2. zigzag(time - previous time)                  |
+ |   3. zigzag(addr - pid's previous addr)            |
+ |      (memory references only)                      |
+ *----------------------------------------------------*/
+typedef struct trace_header_t {
+  unsigned long long magic;
+  unsigned int version;
+  unsigned int max_procs;
+  unsigned long long num_records;  // 0 if the recording did not finish
+
+  // Geometry of the recording, which a replay must match
+  unsigned long long proc_mem;
+  unsigned int page_size;
+  int num_levels;
+  int level_bits[MAX_PAGE_TABLE_LEVELS];
+  int huge_page_pages;
+} trace_header_t;
+
+// Kind of event. READ and WRITE match io_op.
+typedef enum { TRACE_READ, TRACE_WRITE, TRACE_EXIT } trace_kind;
+
+typedef struct trace_record_t {
+  int pid;
+  trace_kind kind;
+  unsigned long long addr;  // Memory references only
+  unsigned long long time;  // Simulated time (in nanoseconds)
+} trace_record_t;
+
+typedef struct trace_writer_t {
+  FILE* file;
+  unsigned char* buf;
+  size_t len;
+  int max_procs;
+  int prev_pid;
+  unsigned long long prev_time;
+  unsigned long long* prev_addr;
+  unsigned long long num_records;
+} trace_writer_t;
+
+typedef struct trace_reader_t {
+  trace_header_t header;
+  unsigned char* map;
+  size_t size;
+  const unsigned char* pos;
+  const unsigned char* end;
+  int max_procs;
+  int prev_pid;
+  unsigned long long prev_time;
+  unsigned long long* prev_addr;
+} trace_reader_t;
+
+int open_trace_writer(trace_writer_t* writer, const char* path, int max_procs);
+void write_trace_record(trace_writer_t* writer, trace_record_t* record);
+int close_trace_writer(trace_writer_t* writer);
+
+int open_trace_reader(trace_reader_t* reader, const char* path);
+int read_trace_record(trace_reader_t* reader, trace_record_t* record);
+void close_trace_reader(trace_reader_t* reader);
+
+#endif
@@ -0,0 +1,409 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "myclock.h"
+#include "workload.h"
+
+static const char* distribution_names[NUM_DISTRIBUTIONS] = {
+  "uniform", "zipf", "seq", "stride", "phases"
+};
+
+static unsigned long long get_mem_addr(workload_t* workload);
+static unsigned long long get_phase_addr(workload_t* workload);
+static io_op get_read_or_write(workload_t* workload);
+static void check_should_terminate(workload_t* workload);
+static int should_check_whether_to_terminate(int num_requests);
+static void init_zipf(zipf_t* zipf, long long n, double theta);
+static long long sample_zipf(zipf_t* zipf, rng_t* rng);
+static double zipf_h(zipf_t* zipf, double x);
+static double zipf_h_integral(zipf_t* zipf, double x);
+static double zipf_h_integral_inverse(zipf_t* zipf, double x);
+static double log1p_over_x(double x);
+static double expm1_over_x(double x);
+
+/**
+ * Sets a workload's shape to the default:
+ * uniform addresses, two reads for every write.
+ */
+void init_workload_config(workload_config_t* config) {
+  config->dist = UNIFORM;
+  config->zipf_theta = DEFAULT_ZIPF_THETA;
+  config->stride = 0;
+  config->phase_length = DEFAULT_PHASE_LENGTH;
+  config->reads = 2;
+  config->writes = 1;
+}
+
+/**
+ * Parses a distribution and its optional parameter:
+ * "uniform", "zipf[,theta]", "seq[,bytes]",
+ * "stride[,bytes]" or "phases[,references]".
+ *
+ * @param  config The workload's shape
+ * @param  spec   The distribution
+ * @return        0 on success. -1 if it is invalid.
+ */
+int parse_workload_distribution(workload_config_t* config, const char* spec) {
+  const char* param = strchr(spec, ',');
+  size_t name_length = param != NULL ? (size_t) (param - spec) : strlen(spec);
+  int dist = 0;
+  for (; dist < NUM_DISTRIBUTIONS; dist++) {
+    if (strlen(distribution_names[dist]) == name_length &&
+        strncmp(spec, distribution_names[dist], name_length) == 0) {
+      break;
+    }
+  }
+  if (dist == NUM_DISTRIBUTIONS) {
+    return -1;
+  }
+  config->dist = dist;
+  config->stride = dist == SEQUENTIAL ? DEFAULT_SEQUENTIAL_STRIDE : 0;
+  if (param == NULL) {
+    return 0;
+  }
+
+  param++;
+  char* end;
+  if (dist == ZIPF) {
+    double theta = strtod(param, &end);
+    if (*param == '\0' || *end != '\0' || !(theta > 0 && theta <= 10)) {
+      return -1;
+    }
+    config->zipf_theta = theta;
+    return 0;
+  }
+  unsigned long long value = strtoull(param, &end, 10);
+  if (*param == '\0' || *end != '\0' || value == 0) {
+    return -1;
+  }
+  if (dist == SEQUENTIAL || dist == STRIDED) {
+    config->stride = value;
+  } else if (dist == PHASES && value <= 1000000000) {
+    config->phase_length = value;
+  } else {
+    return -1;  // Uniform takes no parameter
+  }
+  return 0;
+}
+
+/**
+ * Checks a scan moves through an address space. One whose
+ * stride is a multiple of it would reference one address forever.
+ *
+ * @param  config    The workload's shape
+ * @param  proc_mem  Size of the address space (in bytes)
+ * @param  page_size (in bytes)
+ * @return           1 if it does or the workload is no scan. 0 otherwise.
+ */
+int is_valid_workload_stride(const workload_config_t* config,
+                             unsigned long long proc_mem,
+                             unsigned int page_size) {
+  if (config->dist != SEQUENTIAL && config->dist != STRIDED) {
+    return 1;
+  }
+  unsigned long long stride = config->stride ? config->stride : page_size;
+  return stride % proc_mem != 0;
+}
+
+/**
+ * Parses the ratio of reads to writes, such as "2:1".
+ *
+ * @param  config The workload's shape
+ * @param  spec   The ratio
+ * @return        0 on success. -1 if it is invalid.
+ */
+int parse_workload_ratio(workload_config_t* config, const char* spec) {
+  int reads;
+  int writes;
+  char extra;
+  if (sscanf(spec, "%d:%d%c", &reads, &writes, &extra) != 2 ||
+      reads < 0 || writes < 0 || reads > 1000000 || writes > 1000000 ||
+      reads + writes == 0) {
+    return -1;
+  }
+  config->reads = reads;
+  config->writes = writes;
+  return 0;
+}
+
+const char* get_distribution_name(distribution dist) {
+  return distribution_names[dist];
+}
+
+/**
+ * @param workload  A pointer to the workload
+ * @param config    The workload's shape
+ * @param seed      Seed for the workload's random numbers
+ * @param proc_mem  Size of the process' address space (in bytes)
+ * @param page_size Page size (in bytes)
+ */
+void init_workload(workload_t* workload,
+                   const workload_config_t* config,
+                   unsigned long long seed,
+                   unsigned long long proc_mem,
+                   unsigned int page_size) {
+  seed_rng(&workload->rng, seed);
+  workload->config = *config;
+  workload->proc_mem = proc_mem;
+  workload->page_size = page_size;
+  workload->num_pages = proc_mem / page_size;
+  workload->num_requests = 0;
+  workload->should_terminate = 0;
+
+  if (config->dist == ZIPF) {
+    init_zipf(&workload->zipf, workload->num_pages, config->zipf_theta);
+  }
+
+  // Scans start anywhere and step by less than the address
+  // space, so wrapping around needs no divide
+  unsigned long long stride = config->stride ? config->stride : page_size;
+  workload->config.stride = stride % proc_mem;
+  workload->next_addr = rng_below(&workload->rng, proc_mem);
+
+  long long phase_pages = workload->num_pages / PHASE_WORKING_SET_DIVISOR;
+  if (phase_pages < 1) {
+    phase_pages = 1;
+  }
+  workload->phase_size = phase_pages * page_size;
+  workload->phase_left = 0;
+}
+
+/**
+ * Simulate the overhead of creating a new process.
+ *
+ * @return 1 - 500 milliseconds (in nanoseconds)
+ */
+unsigned int get_creation_time(workload_t* workload) {
+  int rand_num = rng_below(&workload->rng, 500) + 1;
+  return (unsigned) rand_num * NANOSECS_PER_MILLISEC;
+}
+
+/**
+ * Makes up a workload's next memory operation,
+ * without stamping it with a time.
+ *
+ * @param workload A pointer to the workload
+ * @param mem_op   The operation
+ */
+void get_next_mem_op(workload_t* workload, mem_op_t* mem_op) {
+  mem_op->addr = get_mem_addr(workload);
+  mem_op->op   = get_read_or_write(workload);
+}
+
+/**
+ * Makes up a workload's next memory operation, unless
+ * the process decides to terminate first.
+ *
+ * @param  workload A pointer to the workload
+ * @param  mem_op   The operation
+ * @return          1 if there is an operation. 0 once the
+ *                  process has decided to terminate.
+ */
+int get_next_request(workload_t* workload, mem_op_t* mem_op) {
+  if (workload->should_terminate) {
+    return 0;
+  }
+  if (should_check_whether_to_terminate(workload->num_requests)) {
+    check_should_terminate(workload);
+    if (workload->should_terminate) {
+      return 0;
+    }
+  }
+  get_next_mem_op(workload, mem_op);
+  workload->num_requests++;
+  return 1;
+}
+
+/**
+ * Submits memory requests until the ring is full
+ * or the process decides to terminate.
+ *
+ * Each request is stamped with the simulated and real time,
+ * so oss can measure how long it took to complete.
+ *
+ * @param workload      A pointer to the workload
+ * @param ring          The process' ring
+ * @param num_in_flight Requests submitted but not yet reaped
+ * @param clock         The simulated clock
+ * @return              The number of requests submitted
+ */
+int submit_mem_requests(workload_t* workload,
+                        mem_ring_t* ring,
+                        int num_in_flight,
+                        my_clock* clock) {
+  if (workload->should_terminate || num_in_flight == RING_SIZE) {
+    return 0;
+  }
+  unsigned long long submit_time = get_clock_nanosecs(clock);
+  unsigned long long submit_real = get_real_nanosecs();
+  int num_submitted = 0;
+  mem_op_t mem_op;
+  while (num_in_flight + num_submitted < RING_SIZE &&
+         get_next_request(workload, &mem_op)) {
+    mem_op.submit_time = submit_time;
+    mem_op.submit_real = submit_real;
+    ring_submit(ring, &mem_op);
+    num_submitted++;
+  }
+  return num_submitted;
+}
+
+/**
+ * Get a memory address to make a request to,
+ * from the workload's distribution.
+ *
+ * @return A memory address
+ */
+static unsigned long long get_mem_addr(workload_t* workload) {
+  unsigned long long addr;
+  switch (workload->config.dist) {
+    case ZIPF:
+      addr = (sample_zipf(&workload->zipf, &workload->rng) - 1) *
+             workload->page_size;
+      return addr + rng_below(&workload->rng, workload->page_size);
+    case SEQUENTIAL:
+    case STRIDED:
+      addr = workload->next_addr;
+      workload->next_addr += workload->config.stride;
+      if (workload->next_addr >= workload->proc_mem) {
+        workload->next_addr -= workload->proc_mem;
+      }
+      return addr;
+    case PHASES:
+      return get_phase_addr(workload);
+    default:
+      return rng_below(&workload->rng, workload->proc_mem);
+  }
+}
+
+/**
+ * Any address in the current phase's working set, a run of
+ * pages that moves somewhere random when the phase ends.
+ *
+ * @return A memory address
+ */
+static unsigned long long get_phase_addr(workload_t* workload) {
+  if (workload->phase_left == 0) {
+    long long num_starts = workload->num_pages -
+                           workload->phase_size / workload->page_size + 1;
+    workload->phase_start = rng_below(&workload->rng, num_starts) *
+                            workload->page_size;
+    workload->phase_left = workload->config.phase_length;
+  }
+  workload->phase_left--;
+  return workload->phase_start + rng_below(&workload->rng, workload->phase_size);
+}
+
+/**
+ * Get wheter the I/O operation
+ * is a read or write, by the workload's ratio.
+ *
+ * @return Read or write.
+ */
+static io_op get_read_or_write(workload_t* workload) {
+  int num_ops = workload->config.reads + workload->config.writes;
+  if (rng_below(&workload->rng, num_ops) < (unsigned) workload->config.writes) {
+    return WRITE;
+  } else {
+    return READ;
+  }
+}
+
+/**
+ * Check whether the program should terminate.
+ * Sets should_terminate to 1 if so.
+ */
+static void check_should_terminate(workload_t* workload) {
+  workload->should_terminate = rng_next(&workload->rng) >> 63;
+}
+
+static int should_check_whether_to_terminate(int num_requests) {
+  if (num_requests != 0 && num_requests % 100 == 0) {
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+/*--------------------------------------------------*
+ | Zipfian sampling by rejection-inversion, which   |
+ | takes constant time and no table, however many   |
+ | pages there are. (Hormann and Derflinger,        |
+ | "Rejection-inversion to generate variates from   |
+ | monotone discrete distributions", 1996)          |
+ *--------------------------------------------------*/
+
+/**
+ * @param zipf  The sampler
+ * @param n     Number of values, 1 to n
+ * @param theta Skew. Value k is drawn in proportion to 1 / k^theta.
+ */
+static void init_zipf(zipf_t* zipf, long long n, double theta) {
+  zipf->theta = theta;
+  zipf->n = n;
+  zipf->h_integral_x1 = zipf_h_integral(zipf, 1.5) - 1;
+  zipf->h_integral_n = zipf_h_integral(zipf, n + 0.5);
+  zipf->s = 2 - zipf_h_integral_inverse(zipf,
+                                        zipf_h_integral(zipf, 2.5) -
+                                        zipf_h(zipf, 2));
+}
+
+/**
+ * @return A value from 1 to n. Almost every draw
+ *         is accepted on the first try.
+ */
+static long long sample_zipf(zipf_t* zipf, rng_t* rng) {
+  for (;;) {
+    double u = zipf->h_integral_n +
+               rng_double(rng) * (zipf->h_integral_x1 - zipf->h_integral_n);
+    double x = zipf_h_integral_inverse(zipf, u);
+    long long k = x + 0.5;
+    if (k < 1) {
+      k = 1;
+    } else if (k > zipf->n) {
+      k = zipf->n;
+    }
+    if (k - x <= zipf->s ||
+        u >= zipf_h_integral(zipf, k + 0.5) - zipf_h(zipf, k)) {
+      return k;
+    }
+  }
+}
+
+static double zipf_h(zipf_t* zipf, double x) {
+  return exp(-zipf->theta * log(x));
+}
+
+static double zipf_h_integral(zipf_t* zipf, double x) {
+  double log_x = log(x);
+  return expm1_over_x((1 - zipf->theta) * log_x) * log_x;
+}
+
+static double zipf_h_integral_inverse(zipf_t* zipf, double x) {
+  double t = x * (1 - zipf->theta);
+  if (t < -1) {
+    t = -1;  // Rounding error
+  }
+  return exp(log1p_over_x(t) * x);
+}
+
+/**
+ * @return log(1 + x) / x, accurate near 0
+ */
+static double log1p_over_x(double x) {
+  if (fabs(x) > 1e-8) {
+    return log1p(x) / x;
+  }
+  return 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+}
+
+/**
+ * @return (e^x - 1) / x, accurate near 0
+ */
+static double expm1_over_x(double x) {
+  if (fabs(x) > 1e-8) {
+    return expm1(x) / x;
+  }
+  return 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x));
+}
@@ -0,0 +1,93 @@
+#ifndef WORKLOAD_H_
+#define WORKLOAD_H_
+
+#include "myclock.h"
+#include "pagetable.h"
+#include "ring.h"
+#include "rng.h"
+
+/*---------------------------------------*
+ | How a workload picks its addresses    |
+ *---------------------------------------*/
+typedef enum {
+  UNIFORM,     // Any address, equally likely
+  ZIPF,        // Pages by a Zipfian law, page 0 the hottest
+  SEQUENTIAL,  // A scan through the address space
+  STRIDED,     // A scan that skips ahead by a stride
+  PHASES,      // A working set that moves every phase
+  NUM_DISTRIBUTIONS
+} distribution;
+
+// Default parameters of the distributions
+#define DEFAULT_ZIPF_THETA 0.99
+#define DEFAULT_SEQUENTIAL_STRIDE 64  // (in bytes)
+#define DEFAULT_PHASE_LENGTH 1000     // (in references)
+
+// Fraction of the address space a phase's working set covers
+#define PHASE_WORKING_SET_DIVISOR 8
+
+/**
+ * A workload's shape, the same for every process
+ */
+typedef struct workload_config_t {
+  distribution dist;
+  double zipf_theta;          // Skew of ZIPF
+  unsigned long long stride;  // Bytes between references of a scan,
+                              // or 0 for the page size
+  int phase_length;           // References per phase of PHASES
+  int reads;                  // Ratio of reads to writes
+  int writes;
+} workload_config_t;
+
+/**
+ * Constants of a Zipfian sampler over 1 to n
+ */
+typedef struct zipf_t {
+  double theta;
+  double n;
+  double h_integral_x1;
+  double h_integral_n;
+  double s;
+} zipf_t;
+
+/*----------------------------------------*
+ | Memory references made by a simulated  |
+ | process, whether it runs as a user     |
+ | process or inside oss.                 |
+ *----------------------------------------*/
+typedef struct workload_t {
+  rng_t rng;
+  workload_config_t config;
+  unsigned long long proc_mem;     // Size of the address space (in bytes)
+  unsigned int page_size;          // (in bytes)
+  long long num_pages;
+  zipf_t zipf;
+  unsigned long long next_addr;    // Of a scan
+  unsigned long long phase_start;  // Of the working set
+  unsigned long long phase_size;
+  int phase_left;                  // References left in the phase
+  int num_requests;
+  int should_terminate;
+} workload_t;
+
+void init_workload_config(workload_config_t* config);
+int parse_workload_distribution(workload_config_t* config, const char* spec);
+int parse_workload_ratio(workload_config_t* config, const char* spec);
+int is_valid_workload_stride(const workload_config_t* config,
+                             unsigned long long proc_mem,
+                             unsigned int page_size);
+const char* get_distribution_name(distribution dist);
+void init_workload(workload_t* workload,
+                   const workload_config_t* config,
+                   unsigned long long seed,
+                   unsigned long long proc_mem,
+                   unsigned int page_size);
+unsigned int get_creation_time(workload_t* workload);
+void get_next_mem_op(workload_t* workload, mem_op_t* mem_op);
+int get_next_request(workload_t* workload, mem_op_t* mem_op);
+int submit_mem_requests(workload_t* workload,
+                        mem_ring_t* ring,
+                        int num_in_flight,
+                        my_clock* clock);
+
+#endif
@@ -5,75 +5,412 @@
  */
 
 #include <errno.h>
+#include <limits.h>
+#include <pthread.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <sys/shm.h>
+#include <string.h>
+#include <sys/select.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 #include "oss.h"
+#include "lib/frames.h"
+#include "lib/logger.h"
 #include "lib/myclock.h"
+#include "lib/probe.h"
+#include "lib/readahead.h"
+#include "lib/replacement.h"
 #include "lib/stats.h"
 #include "lib/sem.h"
 #include "lib/shm.h"
+#include "lib/swap.h"
+#include "lib/tlb.h"
+#include "lib/trace.h"
+#include "lib/workload.h"
 
 #define INIT_VAL -10
 
-int should_run = 1;
+// Percentage of all frames allocated before replacement runs
+#define REPLACEMENT_THRESHOLD 90
 
-static FILE* log;
+// Most keys a shard's replacement policy remembers pages by
+#define MAX_PAGE_KEYS (1 << 22)
+
+// Most pages of one page table written to the log
+#define MAX_LOGGED_PAGES 4096
+
+// Simulated time to translate an address the TLB holds
+#define TLB_HIT_NANOSECS 1
+
+// Simulated time to walk the page table for a resident page
+#define PAGE_HIT_NANOSECS 10
+
+
+volatile sig_atomic_t should_run = 1;
+
+static logger_t* log;
 int verbose = 0;
 
-// Shared Memory Globals
-static int clock_id;
-static my_clock* clock_shm;
+// Whether a full log buffer blocks or drops records
+static log_policy log_full_policy = LOG_BLOCK;
 
-static int page_tables_id;
-static page* page_tables;
+static policy_type policy = CLOCK;
 
-static int mem_ops_id;
-static mem_op_t* mem_ops;
+// Trace to record every memory reference to, or NULL
+static char* record_path = NULL;
+static trace_writer_t trace_writer;
 
-// For proteting the clock
-static int clock_sem_id;
+// Trace to replay instead of running user processes, or NULL
+static char* replay_path = NULL;
 
-// For making memory references
-static int mem_sem_ids[MAX_PROCS];
+// Run simulated processes inside oss instead of as user processes
+static int in_process = 0;
 
-static char unallocated_frames[TOTAL_PAGES];
+// Run simulated processes as discrete events instead, until a
+// simulated time (ns after the start) or a number of references,
+// whichever -D gives
+static int discrete_events = 0;
+static unsigned long long event_time_limit = 0;
+static unsigned long long event_reference_limit = 0;
 
-static stats_t stats[MAX_PROCS];
+// Processes started, each seeded by its number
+static int num_procs_started = 0;
 
-pid_t children[MAX_PROCS];
+// Processes arriving per second once the first -n have started,
+// each in the PID of one that exited, or 0 if none arrive
+static unsigned int arrival_rate = 0;
 
-int main(int argc, char* argv[]) {
-  srand(time(0));
+// Simulated PIDs free for an arriving process
+static int* free_pids;
+static int num_free_pids = 0;
+
+// Where user is, found once so starting a process
+// searches no PATH, and how it is spawned
+static char user_path[PATH_MAX];
+static posix_spawnattr_t spawn_attr;
+
+// Worker threads handling memory requests
+static int num_workers = 1;
+
+// Seed for simulated processes' random numbers
+static unsigned int seed;
+
+// Shape of every simulated process' references, and the -W
+// and -R arguments that gave it, passed on to user processes
+static workload_config_t workload_config;
+static char* distribution_arg = "uniform";
+static char* ratio_arg = "2:1";
+
+// Time each phase of handling requests and report it at exit
+static int should_profile = 0;
+
+// Each process' TLB, or NULL if there are none
+static int tlb_entries = 64;
+static int tlb_ways = 4;
+static tlb_policy tlb_replacement = TLB_LRU;
+static tlb_t** tlbs = NULL;
+
+// Base pages per huge page given with -H, or 0 for none,
+// and each process' TLB of huge pages, or NULL if there are none
+static int huge_page_pages = 0;
+static tlb_t** huge_tlbs = NULL;
+
+// Most pages read ahead of a stream given with -A, or 0 for
+// none, and each process' read-ahead, or NULL if there is none
+static int max_readahead = DEFAULT_MAX_READAHEAD;
+static readahead_t* readaheads = NULL;
+
+// Dirty pages each swap device writes back together, and its queue depth
+static int writeback_batch = DEFAULT_WRITEBACK_BATCH;
+static int swap_queue_depth = DEFAULT_SWAP_QUEUE_DEPTH;
+
+/**
+ * A simulated process run as a state machine inside oss
+ */
+typedef struct sim_proc_t {
+  workload_t workload;
+  int num_in_flight;
+} sim_proc_t;
+
+static sim_proc_t* sim_procs;
+
+static volatile sig_atomic_t has_child_exited = 0;
+
+// Log every page table once per simulated second
+static int should_log_page_tables = 1;
+
+// Shared Memory Globals, each a region of one arena
+static int arena_fd;
+static arena_t* arena;
+
+// Back the arena with huge pages
+static int use_huge_shm = 0;
+
+static clock_shm_t* clock_shm;
+
+static page_tables_t* page_tables;
+
+// Page table levels given with -L, or 0 for the default
+static int page_table_levels[MAX_PAGE_TABLE_LEVELS];
+static int num_page_table_levels = 0;
+
+static mem_rings_t* mem_rings;
+
+/**
+ * One worker thread's share of the simulation.
+ *
+ * A shard owns a contiguous range of PIDs, with their page tables,
+ * rings and stats, and a contiguous range of frames with its own
+ * replacement policy. Workers never touch another shard's state,
+ * so requests are handled without a global lock. Only the clock is
+ * shared, and each shard adds its time to it once per batch.
+ */
+typedef struct shard_t {
+  int id;  // Also the worker's doorbell channel
+  int first_pid;
+  int num_pids;
+  int first_frame;
+  int num_frames;
+  frame_bitmap_t frames;       // Numbered from first_frame
+  replacement_t* replacement;  // Frames and keys numbered from the shard's first
+  int num_keys;                // Keys the replacement policy knows pages by
+  node_list_t free_nodes;      // Page table nodes freed by the shard
+  swap_device_t swap;          // Backing store of the shard's pages
+  int* unused_readaheads;      // Frames read ahead, oldest first,
+  int first_unused_readahead;  // some since used or freed
+  int num_unused_readaheads;
+  unsigned long long elapsed;  // Nanoseconds not yet added to the clock
+  unsigned long long flushed_at;  // Clock time after the last flush (ns)
+  pthread_mutex_t lock;        // Held while handling requests or an exit
+  pthread_t thread;
+  probes_t* probes;            // NULL unless profiling
+} __attribute__((aligned(CACHE_LINE))) shard_t;
+
+static shard_t* shards;
 
+/**
+ * When a request was made and how far into
+ * its batch it completed, kept until the batch
+ * is flushed so its latency can be recorded.
+ */
+typedef struct latency_sample_t {
+  unsigned long long submit_time;  // Simulated (ns)
+  unsigned long long submit_real;  // Monotonic (ns)
+  unsigned long long elapsed;      // Shard's elapsed time on completion
+} latency_sample_t;
+
+/**
+ * Percentiles of a latency histogram, for a report
+ */
+typedef struct latency_summary_t {
+  unsigned long long count;
+  unsigned long long p50;
+  unsigned long long p99;
+  unsigned long long p999;
+  unsigned long long max;
+} latency_summary_t;
+
+// Every exited process' latencies, merged in at exit
+static histogram_t sim_latency;
+static histogram_t real_latency;
+
+/**
+ * A process' stats report, written out by the log writer
+ */
+typedef struct stats_report_t {
+  int pid;
+  unsigned long long start;  // Simulated (ns)
+  unsigned long long end;
+  int mem_accesses;
+  int num_page_faults;
+  double tlb_hit_rate;
+  double tlb_miss_cost;
+  int num_huge_faults;
+  double avg_page_fault_time;  // Milliseconds
+  int num_writebacks;
+  int num_readaheads;
+  int num_readahead_hits;
+  int num_readaheads_wasted;
+  int num_tlb_hits;
+  int num_huge_tlb_hits;
+  int num_promotions;
+  int num_demotions;
+  unsigned long long base_tlb_reach;  // Bytes
+  unsigned long long huge_tlb_reach;
+  int mem_accesses_per_sec;
+  int page_faults_per_mem_access;
+  double avg_mem_access_speed;
+  double throughput;
+  latency_summary_t sim_latency;
+  latency_summary_t real_latency;
+} stats_report_t;
+
+/**
+ * Totals across every process, written out by the log writer
+ */
+typedef struct policy_report_t {
+  unsigned long long mem_accesses;
+  unsigned long long page_faults;
+  unsigned long long evictions;
+  double fault_rate;
+  double tlb_hit_rate;
+  unsigned long long huge_faults;
+  unsigned long long readaheads;
+  unsigned long long readahead_hits;
+  unsigned long long readaheads_wasted;
+  unsigned long long tlb_hits;
+  unsigned long long huge_tlb_hits;
+  unsigned long long promotions;
+  unsigned long long demotions;
+  double base_tlb_reach;  // Mean bytes per process at exit
+  double huge_tlb_reach;
+  swap_stats_t swap;      // Every shard's swap device
+  latency_summary_t sim_latency;
+  latency_summary_t real_latency;
+} policy_report_t;
+
+/**
+ * A page in a page table snapshot
+ */
+typedef struct logged_page_t {
+  long long num;
+  page pg;
+} logged_page_t;
+
+/**
+ * A snapshot of a process' page table, written out by the log writer.
+ * It has the pages of every leaf of the table, in page order.
+ */
+typedef struct page_table_record_t {
+  int pid;
+  int num_pages;
+  long long num_omitted;  // Pages past MAX_LOGGED_PAGES
+  logged_page_t pages[];
+} page_table_record_t;
+
+// Inverted page table. Owner of each frame.
+static frame_t* frame_table;
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static stats_t* stats;
+
+// Stats of processes whose PIDs were given to new processes
+static stats_totals_t recycled_stats;
+
+static int num_procs_completed = 0;
+
+pid_t* children;
+
+extern char** environ;
+
+int main(int argc, char* argv[]) {
   parse_command_options(argc, argv);
 
   setup_interrupt_handler();
-  setup_interval_timer(2);  // 2 seconds
-  signal(SIGALRM, handle_timer_interrupt);
-  signal(SIGCHLD, handle_child_termination);
 
   open_log_file();
 
   setup_data_structures();
 
+  if (replay_path != NULL) {
+    fprintf(stderr, "Replaying %s. See oss.out for log.\n", replay_path);
+    replay_trace();
+    print_policy_report();
+    print_probe_report();
+    close_log_file();
+    free_shm();
+    return EXIT_SUCCESS;
+  }
+
+  if (record_path != NULL) {
+    start_recording();
+  }
+
+  // Runs to its -D limit however long that takes, so it has no timer
+  if (discrete_events) {
+    fprintf(stderr, "Running oss as discrete events. See oss.out for log.\n");
+    run_events();
+    if (record_path != NULL) {
+      close_trace_writer(&trace_writer);
+    }
+    print_policy_report();
+    print_probe_report();
+    close_log_file();
+    free_shm();
+    return EXIT_SUCCESS;
+  }
+
+  setup_interval_timer(2);  // 2 seconds
+  signal(SIGALRM, handle_timer_interrupt);
+  signal(SIGCHLD, handle_child_termination);
+
+  if (in_process) {
+    fprintf(stderr, "Running oss in-process. See oss.out for log.\n");
+    run_sim_procs();
+    if (record_path != NULL) {
+      close_trace_writer(&trace_writer);
+    }
+    print_policy_report();
+    print_probe_report();
+    close_log_file();
+    free_shm();
+    return EXIT_SUCCESS;
+  }
+
   fprintf(stderr, "Running oss. See oss.out for log.\n");
 
-  fork_and_exec_children();
+  setup_spawning();
+  start_children();
+
+  // Only the main thread takes SIGCHLD and SIGALRM from here on
+  sigset_t old_mask;
+  block_signals(&old_mask);
+  start_workers(serve_shard);
 
-  // Break out of loop after timer interrupt
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  // Workers handle requests. Break out of loop after timer interrupt.
   while (should_run) {
-    check_for_mem_requests();
+    if (has_child_exited) {
+      reap_children();
+    } else if (arrival_rate > 0) {
+      start_arrivals(&start, &old_mask);
+    } else {
+      sigsuspend(&old_mask);
+    }
+  }
+  if (arrival_rate > 0) {
+    double secs = (double) get_elapsed_nanosecs(&start) / NANOSECS_PER_SEC;
+    fprintf(stderr,
+            "Started %d processes in %.3f seconds (%.1f per second)\n",
+            num_procs_started,
+            secs,
+            num_procs_started / secs);
   }
 
+  join_workers();
+
+  // With no workers left to serve them, running processes never finish
+  terminate_children();
   wait_for_all_children();
 
+  if (record_path != NULL) {
+    close_trace_writer(&trace_writer);
+  }
+
+  print_policy_report();
+
+  print_probe_report();
+
+  close_log_file();
+
   free_shm();
 
   return EXIT_SUCCESS;
@@ -81,9 +418,17 @@ int main(int argc, char* argv[]) {
 
 static void parse_command_options(int argc, char* argv[]) {
   int help_flag = 0;
+  int policy_arg;
+  int max_procs = DEFAULT_MAX_PROCS;
+  unsigned int total_mem = DEFAULT_TOTAL_MEM;
+  unsigned int page_size = DEFAULT_PAGE_SIZE;
+  unsigned long long proc_mem = DEFAULT_PROC_MEM;
   int c;
 
-  while ((c = getopt(argc, argv, "hv")) != -1) {
+  seed = time(0);
+  init_workload_config(&workload_config);
+
+  while ((c = getopt(argc, argv, "hvdiPMp:n:m:s:a:r:t:w:S:T:L:H:W:R:B:A:D:c:")) != -1) {
     switch (c) {
       case 'h':
         help_flag = 1;
@@ -91,6 +436,89 @@ static void parse_command_options(int argc, char* argv[]) {
       case 'v':
         verbose = 1;
         break;
+      case 'd':
+        log_full_policy = LOG_DROP;
+        break;
+      case 'i':
+        in_process = 1;
+        break;
+      case 'P':
+        should_profile = 1;
+        break;
+      case 'M':
+        use_huge_shm = 1;
+        break;
+      case 'p':
+        policy_arg = parse_policy_name(optarg);
+        if (policy_arg == -1) {
+          fprintf(stderr, "Unknown page replacement policy '%s'\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        policy = policy_arg;
+        break;
+      case 'n':
+        max_procs = parse_size_option(c, optarg);
+        break;
+      case 'm':
+        total_mem = parse_size_option(c, optarg);
+        break;
+      case 's':
+        page_size = parse_size_option(c, optarg);
+        break;
+      case 'a':
+        proc_mem = parse_number_option(c, optarg, MAX_PROC_MEM);
+        break;
+      case 'r':
+        record_path = optarg;
+        break;
+      case 't':
+        replay_path = optarg;
+        break;
+      case 'w':
+        num_workers = parse_size_option(c, optarg);
+        break;
+      case 'S':
+        seed = parse_size_option(c, optarg);
+        break;
+      case 'T':
+        parse_tlb_option(optarg);
+        break;
+      case 'L':
+        parse_levels_option(optarg);
+        break;
+      case 'H':
+        huge_page_pages = parse_size_option(c, optarg);
+        break;
+      case 'W':
+        if (parse_workload_distribution(&workload_config, optarg) == -1) {
+          fprintf(stderr,
+                  "Invalid workload '%s'. Expected uniform, zipf[,theta],\n"
+                  "seq[,bytes], stride[,bytes] or phases[,references]\n",
+                  optarg);
+          exit(EXIT_FAILURE);
+        }
+        distribution_arg = optarg;
+        break;
+      case 'R':
+        if (parse_workload_ratio(&workload_config, optarg) == -1) {
+          fprintf(stderr, "Invalid value '%s' for -R. Expected reads:writes\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        ratio_arg = optarg;
+        break;
+      case 'B':
+        parse_swap_option(optarg);
+        break;
+      case 'D':
+        parse_event_limit_option(optarg);
+        break;
+      case 'c':
+        arrival_rate = parse_number_option(c, optarg, UINT_MAX);
+        break;
+      case 'A':
+        max_readahead = strcmp(optarg, "off") == 0 ? 0 :
+          parse_number_option(c, optarg, MAX_READAHEAD_PAGES);
+        break;
       default:
         abort();
     }
@@ -100,6 +528,192 @@ static void parse_command_options(int argc, char* argv[]) {
     print_help_message(argv[0]);
     exit(EXIT_SUCCESS);
   }
+
+  // Only user processes arrive over time
+  if (arrival_rate > 0 && (in_process || discrete_events || replay_path != NULL)) {
+    fprintf(stderr, "-c only applies to user processes, not -i, -D or -t\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // Verbose mode logs page tables after every request instead.
+  // High-throughput modes skip them, and so do multiple workers,
+  // since no worker may read another's page tables.
+  should_log_page_tables = !verbose && !in_process && !discrete_events &&
+                           replay_path == NULL &&
+                           num_workers == 1;
+
+  if (set_geometry(max_procs, total_mem, page_size, proc_mem) == -1) {
+    fprintf(stderr,
+            "Memory and address space size must be at least the page size,\n"
+            "and address spaces a multiple of it and at most 2^48 bytes\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (num_page_table_levels > 0 &&
+      set_page_table_levels(page_table_levels, num_page_table_levels) == -1) {
+    fprintf(stderr,
+            "Page tables must have 1 to %d levels of 1 to %d bits,\n"
+            "with enough bits for every page number\n",
+            MAX_PAGE_TABLE_LEVELS,
+            MAX_LEVEL_BITS);
+    exit(EXIT_FAILURE);
+  }
+
+  if (set_huge_page_size(huge_page_pages) == -1) {
+    fprintf(stderr,
+            "Huge pages must be a power of two from 2 to %d pages,\n"
+            "at most a page table leaf and the address space\n",
+            MAX_HUGE_PAGE_PAGES);
+    exit(EXIT_FAILURE);
+  }
+
+  if (!is_valid_workload_stride(&workload_config,
+                                geometry.proc_mem,
+                                geometry.page_size)) {
+    fprintf(stderr,
+            "A scan's stride must not be a multiple of the memory per process\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (tlb_entries > 0 && !is_valid_tlb_geometry(tlb_entries, tlb_ways)) {
+    fprintf(stderr,
+            "TLB entries must be a power of two multiple of its ways\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (num_workers > MAX_DOORBELL_CHANNELS ||
+      num_workers > geometry.max_procs ||
+      num_workers > geometry.total_pages) {
+    fprintf(stderr,
+            "Workers must be at most %d, the number of processes "
+            "and the number of frames\n",
+            MAX_DOORBELL_CHANNELS);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/**
+ * Parses a positive number given to an option.
+ * Exits the program if it is not one.
+ *
+ * @param option The option character
+ * @param arg    The option's argument
+ * @return       The number
+ */
+static unsigned int parse_size_option(int option, char* arg) {
+  return parse_number_option(option, arg, INT_MAX);
+}
+
+/**
+ * Parses a positive number up to a maximum given to an option.
+ * Exits the program if it is not one.
+ *
+ * @param option The option character
+ * @param arg    The option's argument
+ * @param max    The largest number allowed
+ * @return       The number
+ */
+static unsigned long long parse_number_option(int option,
+                                              char* arg,
+                                              unsigned long long max) {
+  char* end;
+  unsigned long long value = strtoull(arg, &end, 10);
+  if (*arg == '\0' || *end != '\0' || value == 0 || value > max) {
+    fprintf(stderr, "Invalid value '%s' for -%c\n", arg, option);
+    exit(EXIT_FAILURE);
+  }
+  return value;
+}
+
+/**
+ * Parses -L, the bits of the page number each
+ * page table level indexes, root first, such as "9,9,9,9".
+ * Exits the program if it is invalid.
+ *
+ * @param arg The option's argument
+ */
+static void parse_levels_option(char* arg) {
+  num_page_table_levels = 0;
+  char* bits = strtok(arg, ",");
+  for (; bits != NULL; bits = strtok(NULL, ",")) {
+    if (num_page_table_levels == MAX_PAGE_TABLE_LEVELS) {
+      fprintf(stderr, "Page tables have at most %d levels\n", MAX_PAGE_TABLE_LEVELS);
+      exit(EXIT_FAILURE);
+    }
+    page_table_levels[num_page_table_levels++] = parse_size_option('L', bits);
+  }
+}
+
+/**
+ * Parses -T, either "off" or the TLB's entries,
+ * and optionally its ways and policy, such as "64,4,lru".
+ * Exits the program if it is invalid.
+ *
+ * @param arg The option's argument
+ */
+static void parse_tlb_option(char* arg) {
+  if (strcmp(arg, "off") == 0) {
+    tlb_entries = 0;
+    return;
+  }
+  char* entries = strtok(arg, ",");
+  char* ways = strtok(NULL, ",");
+  char* policy_name = strtok(NULL, ",");
+  if (entries == NULL || strtok(NULL, ",") != NULL) {
+    fprintf(stderr, "Invalid value for -T. Expected entries[,ways[,policy]]\n");
+    exit(EXIT_FAILURE);
+  }
+  tlb_entries = parse_size_option('T', entries);
+  if (ways != NULL) {
+    tlb_ways = parse_size_option('T', ways);
+  }
+  if (policy_name != NULL) {
+    int policy_arg = parse_tlb_policy_name(policy_name);
+    if (policy_arg == -1) {
+      fprintf(stderr, "Unknown TLB replacement policy '%s'\n", policy_name);
+      exit(EXIT_FAILURE);
+    }
+    tlb_replacement = policy_arg;
+  }
+}
+
+/**
+ * Parses -B, the writeback batch size and
+ * optionally the swap queue depth, such as "16,32".
+ * Exits the program if it is invalid.
+ *
+ * @param arg The option's argument
+ */
+static void parse_swap_option(char* arg) {
+  char* batch = strtok(arg, ",");
+  char* depth = strtok(NULL, ",");
+  if (batch == NULL || strtok(NULL, ",") != NULL) {
+    fprintf(stderr, "Invalid value for -B. Expected batch[,depth]\n");
+    exit(EXIT_FAILURE);
+  }
+  writeback_batch = parse_number_option('B', batch, MAX_WRITEBACK_BATCH);
+  if (depth != NULL) {
+    swap_queue_depth = parse_number_option('B', depth, MAX_SWAP_QUEUE_DEPTH);
+  }
+}
+
+/**
+ * Parses -D, how long discrete-event mode runs: simulated
+ * seconds such as "60s", or a number of references.
+ * Exits the program if it is invalid.
+ *
+ * @param arg The option's argument
+ */
+static void parse_event_limit_option(char* arg) {
+  discrete_events = 1;
+  size_t length = strlen(arg);
+  if (length > 1 && arg[length - 1] == 's') {
+    arg[length - 1] = '\0';
+    event_time_limit = parse_number_option('D', arg, ULLONG_MAX / NANOSECS_PER_SEC / 2) *
+                       NANOSECS_PER_SEC;
+  } else {
+    event_reference_limit = parse_number_option('D', arg, ULLONG_MAX);
+  }
 }
 
 /**
@@ -112,59 +726,200 @@ static void print_help_message(char* executable_name) {
   printf("Arguments:\n");
   printf(" -h  Show help.\n");
   printf(" -v  Verbose log output.\n");
+  printf(" -d  Drop log records instead of waiting when the\n");
+  printf("     log buffer is full.\n");
+  printf(" -i  Run simulated processes inside oss instead of\n");
+  printf("     as user processes.\n");
+  printf(" -D  Run simulated processes as discrete events in\n");
+  printf("     simulated time, for a number of seconds such as\n");
+  printf("     60s or a number of references such as 1000000.\n");
+  printf(" -P  Time each phase of handling requests and\n");
+  printf("     report where the time went at exit.\n");
+  printf(" -M  Back shared memory with huge pages.\n");
+  printf(" -p  Page replacement policy: fifo, lru, clock or arc.\n");
+  printf("     Defaults to clock.\n");
+  printf(" -n  Maximum number of processes. Defaults to %d.\n",
+         DEFAULT_MAX_PROCS);
+  printf(" -c  Processes arriving per second once the first -n\n");
+  printf("     have started, each taking the PID of one that\n");
+  printf("     exited. Only with user processes, not -i, -D\n");
+  printf("     or -t. Defaults to 0.\n");
+  printf(" -m  Total system memory in bytes. Defaults to %d.\n",
+         DEFAULT_TOTAL_MEM);
+  printf(" -s  Page size in bytes. Defaults to %d.\n",
+         DEFAULT_PAGE_SIZE);
+  printf(" -a  Memory per process in bytes, a multiple of the\n");
+  printf("     page size. Defaults to %d.\n",
+         DEFAULT_PROC_MEM);
+  printf(" -r  Record every memory reference to a trace file.\n");
+  printf(" -t  Replay a trace file instead of running user processes.\n");
+  printf(" -w  Number of worker threads handling memory requests.\n");
+  printf("     Defaults to 1.\n");
+  printf(" -S  Seed for simulated processes. Defaults to the time.\n");
+  printf(" -W  How processes pick addresses: uniform, zipf[,theta],\n");
+  printf("     seq[,bytes], stride[,bytes] or phases[,references].\n");
+  printf("     Defaults to uniform.\n");
+  printf(" -R  Ratio of reads to writes. Defaults to 2:1.\n");
+  printf(" -B  Dirty pages written back together, and optionally\n");
+  printf("     the swap device's queue depth, as batch[,depth].\n");
+  printf("     Defaults to %d,%d.\n", DEFAULT_WRITEBACK_BATCH, DEFAULT_SWAP_QUEUE_DEPTH);
+  printf(" -A  Most pages read ahead of a sequential or strided\n");
+  printf("     stream of faults, up to %d, or off. Defaults to %d.\n",
+         MAX_READAHEAD_PAGES,
+         DEFAULT_MAX_READAHEAD);
+  printf(" -L  Bits of the page number each page table level\n");
+  printf("     indexes, root first, such as 9,9,9,9. Defaults to\n");
+  printf("     the fewest levels of at most 9 bits.\n");
+  printf(" -T  Each process' TLB as entries[,ways[,policy]], where\n");
+  printf("     policy is lru or fifo, or off. Defaults to 64,4,lru.\n");
+  printf(" -H  Base pages per huge page, a power of two up to %d.\n",
+         MAX_HUGE_PAGE_PAGES);
+  printf("     Defaults to no huge pages.\n");
 }
 
 static void setup_data_structures() {
-  clock_id = get_clock_shm();
-  clock_shm = attach_to_clock_shm(clock_id);
-  clock_shm->secs = 1;
+  setup_arena();
+
+  set_clock_nanosecs(&clock_shm->clock, NANOSECS_PER_SEC);
 
-  page_tables_id = get_page_tables();
-  page_tables = attach_to_page_tables(page_tables_id);
   setup_page_tables();
 
-  setup_unallocated_frames();
+  stats = allocate(sizeof(stats_t) * geometry.max_procs);
+  children = allocate(sizeof(pid_t) * geometry.max_procs);
+  free_pids = allocate(sizeof(int) * geometry.max_procs);
 
-  mem_ops_id = get_mem_ops(MAX_PROCS);
-  mem_ops = attach_to_mem_ops(mem_ops_id);
-  setup_mem_ops(mem_ops);
+  setup_mem_rings(mem_rings);
 
-  setup_clock_sem();
+  setup_shards();
 
-  setup_mem_sems();
-}
+  setup_tlbs();
 
-static void setup_unallocated_frames() {
-  int i = 0;
-  for (; i < TOTAL_PAGES; i++) {
-    unallocated_frames[i] = 0;
-  }
+  setup_readaheads();
 }
 
 static void open_log_file() {
-  log = fopen("oss.out", "w");
+  log = open_logger("oss.out", DEFAULT_LOG_BUFFER_SIZE, log_full_policy);
 
   if (log == NULL) {
-    perror("Failed to open log file");
     exit(EXIT_FAILURE);
   }
 }
 
+/**
+ * Writes out the rest of the log and
+ * reports any records that were dropped.
+ */
+static void close_log_file() {
+  unsigned long long num_drops = get_log_drops(log);
+  close_logger(log);
+  if (num_drops > 0) {
+    fprintf(stderr, "Dropped %llu log records\n", num_drops);
+  }
+}
+
 static void setup_page_tables() {
+  init_page_tables(page_tables);
+
+  frame_table = allocate(sizeof(frame_t) * geometry.total_pages);
+  int i = 0;
+  for (; i < geometry.total_pages; i++) {
+    frame_table[i].pid = NO_OWNER;
+  }
+}
+
+static void setup_tlbs() {
+  if (tlb_entries == 0) {
+    return;
+  }
+  tlbs = allocate(sizeof(tlb_t*) * geometry.max_procs);
+  int i = 0;
+  for (; i < geometry.max_procs; i++) {
+    tlbs[i] = create_tlb(tlb_entries, tlb_ways, tlb_replacement);
+  }
+  if (geometry.huge_page_pages == 0) {
+    return;
+  }
+  // Huge pages get their own TLB of the same shape, as in
+  // CPUs whose first level TLBs are split by page size
+  huge_tlbs = allocate(sizeof(tlb_t*) * geometry.max_procs);
+  for (i = 0; i < geometry.max_procs; i++) {
+    huge_tlbs[i] = create_tlb(tlb_entries, tlb_ways, tlb_replacement);
+  }
+}
+
+static void setup_readaheads() {
+  if (max_readahead == 0) {
+    return;
+  }
+  readaheads = allocate(sizeof(readahead_t) * geometry.max_procs);
+  int i = 0;
+  for (; i < geometry.max_procs; i++) {
+    init_readahead(readaheads + i, max_readahead);
+  }
+}
+
+/**
+ * Splits the processes and frames between the workers.
+ * Each worker serves the PIDs of its doorbell channel.
+ */
+static void setup_shards() {
+  shards = allocate(sizeof(shard_t) * num_workers);
   int i = 0;
-  for (; i < MAX_PROCS; i++) {
-    int j = 0;
-    for (; j < NUM_FRAMES; j++) {
-      page* pg = get_page(page_tables, i, j);
-      reset_page(pg);
+  for (; i < num_workers; i++) {
+    shard_t* shard = shards + i;
+    shard->id = i;
+    get_doorbell_channel_pids(&mem_rings->doorbell,
+                              i,
+                              &shard->first_pid,
+                              &shard->num_pids);
+    shard->first_frame = (long long) i * geometry.total_pages / num_workers;
+    shard->num_frames = (long long) (i + 1) * geometry.total_pages / num_workers -
+                        shard->first_frame;
+    init_frame_bitmap(&shard->frames, shard->num_frames);
+    long long num_pages = shard->num_pids * geometry.num_proc_pages;
+    shard->num_keys = num_pages < MAX_PAGE_KEYS ? num_pages : MAX_PAGE_KEYS;
+    shard->replacement = create_replacement(policy,
+                                            shard->num_frames,
+                                            shard->num_keys);
+    init_swap_device(&shard->swap,
+                     geometry.page_size,
+                     swap_queue_depth,
+                     writeback_batch);
+    if (max_readahead > 0) {
+      shard->unused_readaheads = allocate(sizeof(int) * shard->num_frames);
+    }
+    pthread_mutex_init(&shard->lock, NULL);
+    if (should_profile) {
+      shard->probes = allocate(sizeof(probes_t));
     }
   }
 }
 
-static void reset_page(page* pg) {
-  pg->num = INIT_VAL;
-  pg->valid = 0;
-  pg->dirty = 0;
+/**
+ * @param pid Simulated PID of a process
+ * @return    The shard that owns the process
+ */
+static shard_t* get_shard(int pid) {
+  return shards + get_doorbell_channel(&mem_rings->doorbell, pid);
+}
+
+/**
+ * Allocates zeroed, cache line aligned memory for oss' own tables.
+ * Exits the program on failure.
+ *
+ * @param size Number of bytes
+ * @return     A pointer to the memory
+ */
+static void* allocate(size_t size) {
+  void* ptr;
+  int error = posix_memalign(&ptr, CACHE_LINE, size);
+  if (error) {
+    errno = error;
+    perror("Failed to allocate memory");
+    exit(EXIT_FAILURE);
+  }
+  memset(ptr, 0, size);
+  return ptr;
 }
 
 /**
@@ -179,18 +934,27 @@ static void free_shm_and_abort(int signum) {
  * Frees all allocated shared memory
  */
 static void free_shm() {
-  detach_from_clock_shm(clock_shm);
-  shmctl(clock_id, IPC_RMID, 0);
-
-  detach_from_page_tables(page_tables);
-  shmctl(page_tables_id, IPC_RMID, 0);
-
-  detach_from_mem_ops(mem_ops);
-  shmctl(mem_ops_id, IPC_RMID, 0);
+  detach_from_arena(arena);
+  close(arena_fd);
+}
 
-  deallocate_sem(clock_sem_id);
+/**
+ * Creates the shared memory arena and finds each region in it.
+ */
+static void setup_arena() {
+  unsigned long long sizes[NUM_REGIONS];
+  sizes[CLOCK_REGION] = sizeof(clock_shm_t);
+  sizes[PAGE_TABLES_REGION] = get_page_tables_size();
+  sizes[MEM_RINGS_REGION] = get_mem_rings_size(geometry.max_procs);
+  arena = create_arena(sizes, use_huge_shm, &arena_fd);
+  if (use_huge_shm && !arena->is_huge) {
+    fprintf(stderr, "No huge pages are reserved, so shared memory "
+                    "asks for transparent huge pages\n");
+  }
 
-  deallocate_mem_sems();
+  clock_shm = get_region(arena, CLOCK_REGION);
+  page_tables = get_region(arena, PAGE_TABLES_REGION);
+  mem_rings = get_region(arena, MEM_RINGS_REGION);
 }
 
 /**
@@ -231,395 +995,1978 @@ static void setup_interval_timer(int time) {
  */
 static void handle_timer_interrupt() {
   should_run = 0;
+  wake_doorbell(&mem_rings->doorbell);
 }
 
-static void fork_and_exec_children() {
+static void start_children() {
   int i = 0;
-  for (; i < MAX_PROCS; i++) {
-    fork_and_exec_child(i);
+  for (; i < geometry.max_procs; i++) {
+    spawn_child(i);
   }
 }
 
-static void handle_child_termination(int signum) {
-  int status;
-  pid_t pid;
-
-  pid = wait(&status);
-  int i = 0;
-  for (; i < MAX_PROCS; i++) {
-    if (children[i] == pid) {
+/**
+ * Starts every process that has arrived by now, while PIDs are
+ * free, then sleeps until the next arrives or a signal comes.
+ * Processes that arrive while every PID is taken wait for one.
+ *
+ * @param start    When the first processes started
+ * @param old_mask Signals to unblock while asleep
+ */
+static void start_arrivals(struct timespec* start, sigset_t* old_mask) {
+  unsigned long long nanosecs_per_arrival = NANOSECS_PER_SEC / arrival_rate;
+  unsigned long long now = get_elapsed_nanosecs(start);
+  unsigned long long next_arrival;
+  for (;;) {
+    next_arrival = (num_procs_started - geometry.max_procs + 1) * nanosecs_per_arrival;
+    if (next_arrival > now || num_free_pids == 0) {
       break;
     }
+    start_arrival(free_pids[--num_free_pids]);
   }
-  children[i] = INIT_VAL;
-  fprintf(log,
-          "PID %d terminating. Freeing memory\n\n",
-          i);
-  free_memory(i);
-  stats[i].end_time.secs     = clock_shm->secs;
-  stats[i].end_time.nanosecs = clock_shm->nanosecs;
-
-  print_stats_report(i);
-}
 
-static int get_num_procs_completed() {
-  int i = 0;
-  int num_procs_completed = 0;
-  for (; i < MAX_PROCS; i++) {
-    if (children[i] == INIT_VAL) {
-      num_procs_completed++;
-    }
+  if (num_free_pids == 0) {
+    sigsuspend(old_mask);
+    return;
   }
-  return num_procs_completed;
+  unsigned long long wait = next_arrival - now;
+  struct timespec timeout = {
+    .tv_sec = get_secs(wait),
+    .tv_nsec = get_subsec_nanosecs(wait),
+  };
+  pselect(0, NULL, NULL, NULL, &timeout, old_mask);
 }
 
-static void free_memory(int pid) {
-  int i = 0;
-  do {
-    page* pg = get_page(page_tables, pid, i);
-    reset_page(pg);
-    i++;
-  } while (i < NUM_FRAMES);
+/**
+ * Starts an arriving process in the PID of one that exited.
+ *
+ * @param pid Simulated PID of the process
+ */
+static void start_arrival(int pid) {
+  // The last process may have left a wakeup on its ring
+  shard_t* shard = get_shard(pid);
+  pthread_mutex_lock(&shard->lock);
+  init_ring(get_ring(mem_rings, pid), get_sem_spin());
+  pthread_mutex_unlock(&shard->lock);
+  recycle_proc_slot(pid);
+  spawn_child(pid);
 }
 
-static void print_stats_report(int pid) {
-  int title_length = 22;
-  fprintf(log, "Process %d Stats Report\n", pid);
-  print_stats_report_separator(title_length);
-
-  my_clock start = stats[pid].start_time;
-  my_clock end = stats[pid].end_time;
-  int num_page_faults = stats[pid].num_page_faults;
-  int mem_accesses = stats[pid].num_mem_accesses;
-
-  int secs_lived = end.secs - start.secs;
-  int mem_accesses_per_sec = mem_accesses / secs_lived;
-  int page_faults_per_mem_access = num_page_faults * 100 / mem_accesses;
-  unsigned int avg_mem_access_speed = get_avg_mem_access_speed(mem_accesses,
-                                                               num_page_faults);
-  int num_procs_completed = get_num_procs_completed();
-  double throughput = (double) num_procs_completed / (double) clock_shm->secs;
-  fprintf(log, "Start Time: %d:%d\n", start.secs, start.nanosecs);
-  fprintf(log, "End Time: %d:%d\n", end.secs, end.nanosecs);
-  fprintf(log, "Number of Memory Accesses: %d\n", mem_accesses);
-  fprintf(log, "Number of Page Faults: %d\n", num_page_faults);
-  fprintf(log, "Memory Accesses per Second: %d\n", mem_accesses_per_sec);
-  fprintf(log, "Page Faults per Memory Access: %d%%\n", page_faults_per_mem_access);
-  fprintf(log, "Average Memory Acess Speed: %d millseconds\n", avg_mem_access_speed);
-  fprintf(log, "Throughput: %f processes per second\n", throughput);
-  print_stats_report_separator(title_length);
-  fprintf(log, "\n");
-}
-
-static void print_stats_report_separator(int length) {
-  int i = 0; for (; i < length; i++) fprintf(log, "-");
-  fprintf(log, "\n");
-}
-
-static unsigned int get_avg_mem_access_speed(int mem_accesses, int page_faults) {
-  unsigned int mem_access_time = (mem_accesses - page_faults) * 10;
-  unsigned int page_fault_time = page_faults * 15 * NANOSECS_PER_MILLISEC;
-  unsigned int total_time = mem_access_time + page_fault_time;
-  unsigned int avg_time_in_nanosecs = total_time / mem_accesses;
-  return avg_time_in_nanosecs / NANOSECS_PER_MILLISEC;
+/**
+ * Wakes the main loop, which reaps the child.
+ *
+ * Terminations are handled outside the signal handler, under the
+ * lock of the process' shard, so they never interleave with a
+ * memory request.
+ */
+static void handle_child_termination(int signum) {
+  has_child_exited = 1;
 }
 
 /**
- * Forks and execs a child process.
- * 
- * @param pid Simulated PID of child
+ * Blocks SIGCHLD and SIGALRM. Threads started
+ * afterwards inherit the blocked signals.
+ *
+ * @param old_mask Set to the signals blocked before
  */
-static void fork_and_exec_child(int pid) {
-  stats[pid].start_time.secs     = clock_shm->secs;
-  stats[pid].start_time.nanosecs = clock_shm->nanosecs;
-  children[pid] = fork();
-
-  if (children[pid] == -1) {
-    perror("Failed to fork");
-    exit(EXIT_FAILURE);
-  }
+static void block_signals(sigset_t* old_mask) {
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigaddset(&mask, SIGALRM);
+  pthread_sigmask(SIG_BLOCK, &mask, old_mask);
+}
 
-  if (children[pid] == 0) {  // Child
-    char pid_str[12];
-    snprintf(pid_str,
-             sizeof(pid_str),
-             "%d",
-             pid);
-
-    char clock_id_str[12];
-    snprintf(clock_id_str,
-             sizeof(clock_id_str),
-             "%d",
-             clock_id);
-
-    char clock_sem_id_str[12];
-    snprintf(clock_sem_id_str,
-             sizeof(clock_sem_id_str),
-             "%d",
-             clock_sem_id);
-
-    char mem_ops_id_str[12];
-    snprintf(mem_ops_id_str,
-             sizeof(mem_ops_id_str),
-             "%d",
-             mem_ops_id);
-
-    char mem_sem_id_str[12];
-    snprintf(mem_sem_id_str,
-             sizeof(mem_sem_id_str),
-             "%d",
-             mem_sem_ids[pid]);
-
-    execlp("user",
-           "user",
-           pid_str,
-           clock_id_str,
-           clock_sem_id_str,
-           mem_ops_id_str,
-           mem_sem_id_str,
-           (char*) NULL);
-    perror("Failed to exec");
-    _exit(EXIT_FAILURE);
-  }
-}
-
-static void check_for_mem_requests() {
-  int i = 0;
-  for (; i < MAX_PROCS; i++) {
-    if (has_mem_request(mem_ops[i])) {
-      handle_mem_request(i, (mem_ops + i));
-      if (verbose) print_page_table(i);
-      if (should_run_page_replacement(i)) {
-        run_page_replacement(i);
+/**
+ * Starts a thread per shard.
+ *
+ * @param work What each thread runs, given its shard
+ */
+static void start_workers(void* (*work)(void*)) {
+  int i = 0;
+  for (; i < num_workers; i++) {
+    int error = pthread_create(&shards[i].thread, NULL, work, shards + i);
+    if (error) {
+      errno = error;
+      perror("Failed to start worker thread");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+static void join_workers() {
+  int i = 0;
+  for (; i < num_workers; i++) {
+    pthread_join(shards[i].thread, NULL);
+  }
+}
+
+/**
+ * Handles memory requests from a shard's
+ * processes until the timer interrupt.
+ *
+ * @param arg The shard
+ */
+static void* serve_shard(void* arg) {
+  shard_t* shard = arg;
+  if (shard->probes) open_probes(shard->probes);
+  while (should_run) {
+    if (!check_for_mem_requests(shard)) {
+      wait_for_doorbell(&mem_rings->doorbell, shard->id);
+    }
+  }
+  if (shard->probes) close_probes(shard->probes);
+  return NULL;
+}
+
+/**
+ * Handles every child that has terminated.
+ */
+static void reap_children() {
+  has_child_exited = 0;
+  pid_t pid;
+  while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+    int sim_pid = find_child(pid);
+    handle_process_exit(sim_pid);
+    if (arrival_rate > 0 && sim_pid < geometry.max_procs) {
+      free_pids[num_free_pids++] = sim_pid;
+    }
+  }
+}
+
+/**
+ * @param pid Real PID of a child
+ * @return    Simulated PID of the child
+ */
+static int find_child(pid_t pid) {
+  int i = 0;
+  for (; i < geometry.max_procs; i++) {
+    if (children[i] == pid) {
+      break;
+    }
+  }
+  return i;
+}
+
+/**
+ * Frees a terminated process' memory and reports its stats.
+ *
+ * @param pid Simulated PID of the process
+ */
+static void handle_process_exit(int pid) {
+  if (pid >= geometry.max_procs) {
+    return;
+  }
+  shard_t* shard = get_shard(pid);
+  pthread_mutex_lock(&shard->lock);
+  if (children[pid] == INIT_VAL) {
+    pthread_mutex_unlock(&shard->lock);
+    return;
+  }
+  children[pid] = INIT_VAL;
+  __atomic_add_fetch(&num_procs_completed, 1, __ATOMIC_RELAXED);
+  if (record_path != NULL) {
+    record_event(shard, pid, TRACE_EXIT, 0);
+  }
+  log_ints(log, "PID %d terminating. Freeing memory\n\n", pid, 0, 0);
+  record_tlb_reach(pid);
+  free_memory(shard, pid);
+  stats[pid].end_time = get_clock_nanosecs(&clock_shm->clock);
+  merge_histogram(&sim_latency, &stats[pid].sim_latency);
+  merge_histogram(&real_latency, &stats[pid].real_latency);
+
+  print_stats_report(pid);
+  pthread_mutex_unlock(&shard->lock);
+}
+
+/**
+ * Readies a PID for a new process, keeping the stats of
+ * the one that exited from it for the policy report.
+ *
+ * @param pid Simulated PID of the process
+ */
+static void recycle_proc_slot(int pid) {
+  if (stats[pid].end_time != 0) {
+    add_to_totals(&recycled_stats, &stats[pid]);
+  }
+  memset(&stats[pid], 0, sizeof(stats_t));
+  stats[pid].start_time = get_clock_nanosecs(&clock_shm->clock);
+  children[pid] = 0;
+}
+
+static int get_num_procs_completed() {
+  return __atomic_load_n(&num_procs_completed, __ATOMIC_RELAXED);
+}
+
+/**
+ * Records how much memory a process' TLBs map
+ * before they are flushed, for its stats report.
+ *
+ * @param pid Simulated PID of the process
+ */
+static void record_tlb_reach(int pid) {
+  stats[pid].has_tlb_reach = 1;
+  if (tlbs != NULL) {
+    stats[pid].base_tlb_reach =
+      (unsigned long long) count_tlb_entries(tlbs[pid]) * geometry.page_size;
+  }
+  if (huge_tlbs != NULL) {
+    stats[pid].huge_tlb_reach =
+      (unsigned long long) count_tlb_entries(huge_tlbs[pid]) *
+      geometry.huge_page_pages * geometry.page_size;
+  }
+}
+
+/**
+ * Returns every frame a process holds to the shared pool.
+ *
+ * @param pid Simulated PID of the process
+ */
+static void free_memory(shard_t* shard, int pid) {
+  if (tlbs != NULL) {
+    tlb_flush(tlbs[pid]);
+  }
+  if (huge_tlbs != NULL) {
+    tlb_flush(huge_tlbs[pid]);
+  }
+  if (readaheads != NULL) {
+    init_readahead(readaheads + pid, max_readahead);
+  }
+  for_each_leaf(page_tables, pid, release_leaf_frames, shard);
+  free_page_table(page_tables, pid, &shard->free_nodes);
+}
+
+/**
+ * Frees the frames of a page table leaf's resident pages.
+ *
+ * @param arg The shard that owns the process
+ */
+static void release_leaf_frames(long long first_page,
+                                page* pages,
+                                int num_pages,
+                                void* arg) {
+  shard_t* shard = arg;
+  int i = 0;
+  for (; i < num_pages; i++) {
+    if (pages[i].valid) {
+      replacement_forget(shard->replacement, pages[i].num - shard->first_frame);
+      release_frame(shard, pages[i].num);
+    }
+  }
+}
+
+/**
+ * Logs a process' stats as one record,
+ * so other workers' reports never interleave with it.
+ *
+ * @param pid Simulated PID of the process
+ */
+static void print_stats_report(int pid) {
+  stats_report_t* report = reserve_log_record(log,
+                                              format_stats_report,
+                                              sizeof(stats_report_t));
+  if (report == NULL) {
+    return;
+  }
+
+  unsigned long long start = stats[pid].start_time;
+  unsigned long long end = stats[pid].end_time;
+  int num_page_faults = stats[pid].num_page_faults;
+  int num_tlb_hits = stats[pid].num_tlb_hits;
+  int mem_accesses = stats[pid].num_mem_accesses;
+  unsigned long long fault_nanosecs = stats[pid].fault_nanosecs;
+
+  int secs_lived = get_secs(end) - get_secs(start);
+  int mem_accesses_per_sec = secs_lived ? mem_accesses / secs_lived
+                                        : mem_accesses;
+  int page_faults_per_mem_access = 0;
+  double avg_mem_access_speed = 0;
+  double tlb_hit_rate = 0;
+  double tlb_miss_cost = 0;
+  if (mem_accesses > 0) {
+    page_faults_per_mem_access = num_page_faults * 100 / mem_accesses;
+    avg_mem_access_speed = get_avg_mem_access_speed(mem_accesses,
+                                                    num_page_faults,
+                                                    num_tlb_hits,
+                                                    fault_nanosecs);
+    tlb_hit_rate = (double) num_tlb_hits * 100 / mem_accesses;
+  }
+  int num_tlb_misses = mem_accesses - num_tlb_hits;
+  if (num_tlb_misses > 0) {
+    tlb_miss_cost = ((double) (num_tlb_misses - num_page_faults) * PAGE_HIT_NANOSECS +
+                     (double) fault_nanosecs) / num_tlb_misses;
+  }
+  int num_completed = get_num_procs_completed();
+  double throughput = (double) num_completed /
+                      get_secs(get_clock_nanosecs(&clock_shm->clock));
+
+  report->pid = pid;
+  report->start = start;
+  report->end = end;
+  report->mem_accesses = mem_accesses;
+  report->num_page_faults = num_page_faults;
+  report->tlb_hit_rate = tlb_hit_rate;
+  report->tlb_miss_cost = tlb_miss_cost;
+  report->num_huge_faults = stats[pid].num_huge_faults;
+  report->avg_page_fault_time = num_page_faults ?
+    (double) fault_nanosecs / num_page_faults / NANOSECS_PER_MILLISEC : 0;
+  report->num_writebacks = stats[pid].num_writebacks;
+  report->num_readaheads = stats[pid].num_readaheads;
+  report->num_readahead_hits = stats[pid].num_readahead_hits;
+  report->num_readaheads_wasted = stats[pid].num_readaheads_wasted;
+  report->num_tlb_hits = num_tlb_hits;
+  report->num_huge_tlb_hits = stats[pid].num_huge_tlb_hits;
+  report->num_promotions = stats[pid].num_promotions;
+  report->num_demotions = stats[pid].num_demotions;
+  report->base_tlb_reach = stats[pid].base_tlb_reach;
+  report->huge_tlb_reach = stats[pid].huge_tlb_reach;
+  report->mem_accesses_per_sec = mem_accesses_per_sec;
+  report->page_faults_per_mem_access = page_faults_per_mem_access;
+  report->avg_mem_access_speed = avg_mem_access_speed;
+  report->throughput = throughput;
+  summarize_latency(&stats[pid].sim_latency, &report->sim_latency);
+  summarize_latency(&stats[pid].real_latency, &report->real_latency);
+  commit_log_record(log, report);
+}
+
+/**
+ * Writes out a stats report. Called by the log writer.
+ */
+static void format_stats_report(FILE* out, const void* data) {
+  const stats_report_t* report = data;
+  int title_length = 22;
+  fprintf(out, "Process %d Stats Report\n", report->pid);
+  print_stats_report_separator(out, title_length);
+  fprintf(out,
+          "Start Time: %u:%u\n",
+          get_secs(report->start),
+          get_subsec_nanosecs(report->start));
+  fprintf(out,
+          "End Time: %u:%u\n",
+          get_secs(report->end),
+          get_subsec_nanosecs(report->end));
+  fprintf(out, "Number of Memory Accesses: %d\n", report->mem_accesses);
+  fprintf(out, "Number of Page Faults: %d\n", report->num_page_faults);
+  fprintf(out, "Memory Accesses per Second: %d\n", report->mem_accesses_per_sec);
+  fprintf(out, "Page Faults per Memory Access: %d%%\n", report->page_faults_per_mem_access);
+  fprintf(out, "Average Page Fault Time: %.3f milliseconds\n", report->avg_page_fault_time);
+  fprintf(out, "Dirty Pages Written Back: %d\n", report->num_writebacks);
+  if (readaheads != NULL) {
+    print_readahead_stats(out,
+                          report->num_readaheads,
+                          report->num_readahead_hits,
+                          report->num_readaheads_wasted);
+  }
+  if (tlbs != NULL) {
+    fprintf(out, "TLB Hit Rate: %.2f%%\n", report->tlb_hit_rate);
+    fprintf(out, "TLB Miss Cost: %.0f nanoseconds\n", report->tlb_miss_cost);
+  }
+  if (geometry.huge_page_pages > 0) {
+    fprintf(out,
+            "Page Faults by Page Size: %d base, %d huge\n",
+            report->num_page_faults - report->num_huge_faults,
+            report->num_huge_faults);
+    fprintf(out,
+            "Huge Page Promotions: %d, Demotions: %d\n",
+            report->num_promotions,
+            report->num_demotions);
+  }
+  if (huge_tlbs != NULL) {
+    fprintf(out,
+            "TLB Hits by Page Size: %d base, %d huge\n",
+            report->num_tlb_hits - report->num_huge_tlb_hits,
+            report->num_huge_tlb_hits);
+    fprintf(out,
+            "TLB Reach at Exit: %llu bytes base, %llu bytes huge\n",
+            report->base_tlb_reach,
+            report->huge_tlb_reach);
+  }
+  fprintf(out, "Page Replacement Policy: %s\n", get_policy_name(policy));
+  fprintf(out, "Average Memory Acess Speed: %.3f millseconds\n", report->avg_mem_access_speed);
+  fprintf(out, "Throughput: %f processes per second\n", report->throughput);
+  print_latency_summary(out, "Simulated Latency", &report->sim_latency);
+  print_latency_summary(out, "Real Latency", &report->real_latency);
+  print_stats_report_separator(out, title_length);
+  fprintf(out, "\n");
+}
+
+/**
+ * Prints the fault rate of the page replacement
+ * policy across every process, so policies
+ * can be compared from run to run.
+ */
+static void print_policy_report() {
+  stats_totals_t totals = recycled_stats;
+  int i = 0;
+  for (; i < geometry.max_procs; i++) {
+    add_to_totals(&totals, &stats[i]);
+  }
+  double fault_rate = totals.mem_accesses ?
+    (double) totals.page_faults * 100 / (double) totals.mem_accesses : 0;
+  double tlb_hit_rate = totals.mem_accesses ?
+    (double) totals.tlb_hits * 100 / (double) totals.mem_accesses : 0;
+
+  policy_report_t* report = reserve_log_record(log,
+                                               format_policy_report,
+                                               sizeof(policy_report_t));
+  if (report != NULL) {
+    report->mem_accesses = totals.mem_accesses;
+    report->page_faults = totals.page_faults;
+    report->evictions = totals.evictions;
+    report->fault_rate = fault_rate;
+    report->tlb_hit_rate = tlb_hit_rate;
+    report->huge_faults = totals.huge_faults;
+    report->readaheads = totals.readaheads;
+    report->readahead_hits = totals.readahead_hits;
+    report->readaheads_wasted = totals.readaheads_wasted;
+    report->tlb_hits = totals.tlb_hits;
+    report->huge_tlb_hits = totals.huge_tlb_hits;
+    report->promotions = totals.promotions;
+    report->demotions = totals.demotions;
+    if (totals.num_tlb_reaches > 0) {
+      report->base_tlb_reach = (double) totals.base_tlb_reach / totals.num_tlb_reaches;
+      report->huge_tlb_reach = (double) totals.huge_tlb_reach / totals.num_tlb_reaches;
+    } else {
+      report->base_tlb_reach = 0;
+      report->huge_tlb_reach = 0;
+    }
+    report->swap = (swap_stats_t) { 0 };
+    for (i = 0; i < num_workers; i++) {
+      merge_swap_stats(&report->swap, &shards[i].swap.stats);
+    }
+    summarize_latency(&sim_latency, &report->sim_latency);
+    summarize_latency(&real_latency, &report->real_latency);
+    commit_log_record(log, report);
+  }
+  fprintf(stderr, "%s: %.2f%% page fault rate\n",
+          get_policy_name(policy),
+          fault_rate);
+}
+
+/**
+ * Adds a process' stats to a sum of many.
+ */
+static void add_to_totals(stats_totals_t* totals, const stats_t* proc) {
+  totals->num_tlb_reaches += proc->has_tlb_reach;
+  totals->mem_accesses += proc->num_mem_accesses;
+  totals->page_faults += proc->num_page_faults;
+  totals->evictions += proc->num_evictions;
+  totals->tlb_hits += proc->num_tlb_hits;
+  totals->huge_faults += proc->num_huge_faults;
+  totals->readaheads += proc->num_readaheads;
+  totals->readahead_hits += proc->num_readahead_hits;
+  totals->readaheads_wasted += proc->num_readaheads_wasted;
+  totals->huge_tlb_hits += proc->num_huge_tlb_hits;
+  totals->promotions += proc->num_promotions;
+  totals->demotions += proc->num_demotions;
+  totals->base_tlb_reach += proc->base_tlb_reach;
+  totals->huge_tlb_reach += proc->huge_tlb_reach;
+}
+
+/**
+ * Writes out the policy report. Called by the log writer.
+ */
+static void format_policy_report(FILE* out, const void* data) {
+  const policy_report_t* report = data;
+  int title_length = 25;
+  fprintf(out, "Page Replacement Report\n");
+  print_stats_report_separator(out, title_length);
+  fprintf(out, "Policy: %s\n", get_policy_name(policy));
+  fprintf(out, "Workers: %d\n", num_workers);
+  if (replay_path == NULL) {
+    fprintf(out, "Workload: %s, %s reads to writes\n", distribution_arg, ratio_arg);
+  }
+  fprintf(out, "Number of Memory Accesses: %llu\n", report->mem_accesses);
+  fprintf(out, "Number of Page Faults: %llu\n", report->page_faults);
+  fprintf(out, "Number of Evictions: %llu\n", report->evictions);
+  fprintf(out, "Page Fault Rate: %.2f%%\n", report->fault_rate);
+  print_swap_stats(out, &report->swap);
+  if (readaheads != NULL) {
+    print_readahead_stats(out,
+                          report->readaheads,
+                          report->readahead_hits,
+                          report->readaheads_wasted);
+  }
+  if (tlbs != NULL) {
+    fprintf(out, "TLB Hit Rate: %.2f%%\n", report->tlb_hit_rate);
+  }
+  if (geometry.huge_page_pages > 0) {
+    fprintf(out,
+            "Page Faults by Page Size: %llu base, %llu huge\n",
+            report->page_faults - report->huge_faults,
+            report->huge_faults);
+    fprintf(out,
+            "Huge Page Promotions: %llu, Demotions: %llu\n",
+            report->promotions,
+            report->demotions);
+  }
+  if (huge_tlbs != NULL) {
+    fprintf(out,
+            "TLB Hits by Page Size: %llu base, %llu huge\n",
+            report->tlb_hits - report->huge_tlb_hits,
+            report->huge_tlb_hits);
+    fprintf(out,
+            "Mean TLB Reach at Exit: %.0f bytes base, %.0f bytes huge\n",
+            report->base_tlb_reach,
+            report->huge_tlb_reach);
+  }
+  print_latency_summary(out, "Simulated Latency", &report->sim_latency);
+  print_latency_summary(out, "Real Latency", &report->real_latency);
+  print_stats_report_separator(out, title_length);
+}
+
+/**
+ * Writes out what the swap devices did.
+ */
+static void print_swap_stats(FILE* out, const swap_stats_t* swap) {
+  fprintf(out,
+          "Swap Reads: %llu requests, %llu pages, %.3f milliseconds average\n",
+          swap->reads,
+          swap->pages_read,
+          swap->reads ? (double) swap->read_nanosecs / swap->reads / NANOSECS_PER_MILLISEC
+                      : 0);
+  fprintf(out,
+          "Swap Writes: %llu requests, %llu pages, %.2f pages per request\n",
+          swap->writes,
+          swap->pages_written,
+          swap->writes ? (double) swap->pages_written / swap->writes : 0);
+  fprintf(out,
+          "Writeback Stalls: %.3f milliseconds\n",
+          (double) swap->stall_nanosecs / NANOSECS_PER_MILLISEC);
+  fprintf(out, "Faults on Pages Awaiting Writeback: %llu\n", swap->buffer_hits);
+  if (readaheads != NULL) {
+    fprintf(out,
+            "Swap Read-Ahead: %llu requests, %llu pages\n",
+            swap->readaheads,
+            swap->pages_read_ahead);
+  }
+}
+
+/**
+ * Writes out how many pages were read ahead, and how many of
+ * them were used. Pages neither used nor evicted were still
+ * resident when their process exited or the run ended.
+ */
+static void print_readahead_stats(FILE* out,
+                                  unsigned long long num_pages,
+                                  unsigned long long num_used,
+                                  unsigned long long num_wasted) {
+  fprintf(out,
+          "Pages Read Ahead: %llu, %.2f%% used, %llu evicted unused\n",
+          num_pages,
+          num_pages ? (double) num_used * 100 / num_pages : 0,
+          num_wasted);
+}
+
+static void summarize_latency(histogram_t* hist, latency_summary_t* summary) {
+  summary->count = hist->count;
+  summary->p50 = get_histogram_percentile(hist, 50);
+  summary->p99 = get_histogram_percentile(hist, 99);
+  summary->p999 = get_histogram_percentile(hist, 99.9);
+  summary->max = hist->max;
+}
+
+static void print_latency_summary(FILE* out,
+                                  const char* name,
+                                  const latency_summary_t* summary) {
+  if (summary->count == 0) {
+    fprintf(out, "%s: none recorded\n", name);
+    return;
+  }
+  fprintf(out, "%s (ns): p50 %llu, p99 %llu, p99.9 %llu, max %llu\n",
+          name,
+          summary->p50,
+          summary->p99,
+          summary->p999,
+          summary->max);
+}
+
+static void print_stats_report_separator(FILE* out, int length) {
+  int i = 0; for (; i < length; i++) fprintf(out, "-");
+  fprintf(out, "\n");
+}
+
+/**
+ * @return The average time a memory access took, in milliseconds
+ */
+static double get_avg_mem_access_speed(int mem_accesses,
+                                       int page_faults,
+                                       int tlb_hits,
+                                       unsigned long long fault_nanosecs) {
+  unsigned long long tlb_hit_time = (unsigned long long) tlb_hits * TLB_HIT_NANOSECS;
+  unsigned long long page_hit_time =
+    (unsigned long long) (mem_accesses - page_faults - tlb_hits) * PAGE_HIT_NANOSECS;
+  unsigned long long total_time = tlb_hit_time + page_hit_time + fault_nanosecs;
+  double avg_time_in_nanosecs = (double) total_time / mem_accesses;
+  return avg_time_in_nanosecs / NANOSECS_PER_MILLISEC;
+}
+
+/**
+ * Each process' seed depends only on -S and its PID,
+ * so runs with the same seed make the same references.
+ *
+ * @param pid Simulated PID of the process
+ * @return    The seed for its workload
+ */
+static unsigned long long get_proc_seed(int pid) {
+  return (unsigned long long) seed << 32 | (unsigned int) pid;
+}
+
+/**
+ * Finds user the way execlp would, and sets up spawning it
+ * with no signals blocked. Exits the program if it is missing.
+ */
+static void setup_spawning() {
+  const char* path = getenv("PATH");
+  if (path == NULL) {
+    path = "/bin:/usr/bin";
+  }
+  for (;;) {
+    const char* end = strchr(path, ':');
+    int length = end ? end - path : (int) strlen(path);
+    // An empty entry is the working directory
+    snprintf(user_path, sizeof(user_path), "%.*s%suser",
+             length, path, length ? "/" : "");
+    if (access(user_path, X_OK) == 0) {
+      break;
+    }
+    if (end == NULL) {
+      fprintf(stderr, "Failed to find user in PATH\n");
+      free_shm();
+      exit(EXIT_FAILURE);
+    }
+    path = end + 1;
+  }
+
+  sigset_t no_signals;
+  sigemptyset(&no_signals);
+  posix_spawnattr_init(&spawn_attr);
+  posix_spawnattr_setsigmask(&spawn_attr, &no_signals);
+  posix_spawnattr_setflags(&spawn_attr, POSIX_SPAWN_SETSIGMASK);
+}
+
+/**
+ * Starts a user process. posix_spawn neither copies
+ * oss' page tables, as fork does, nor searches PATH.
+ *
+ * @param pid Simulated PID of child
+ */
+static void spawn_child(int pid) {
+  char pid_str[12];
+  snprintf(pid_str, sizeof(pid_str), "%d", pid);
+
+  char arena_fd_str[12];
+  snprintf(arena_fd_str, sizeof(arena_fd_str), "%d", arena_fd);
+
+  char proc_mem_str[21];
+  snprintf(proc_mem_str, sizeof(proc_mem_str), "%llu", geometry.proc_mem);
+
+  char page_size_str[12];
+  snprintf(page_size_str, sizeof(page_size_str), "%u", geometry.page_size);
+
+  char seed_str[21];
+  snprintf(seed_str,
+           sizeof(seed_str),
+           "%llu",
+           get_proc_seed(num_procs_started++));
+
+  char* argv[] = {
+    "user",
+    pid_str,
+    arena_fd_str,
+    proc_mem_str,
+    page_size_str,
+    seed_str,
+    distribution_arg,
+    ratio_arg,
+    NULL
+  };
+
+  stats[pid].start_time = get_clock_nanosecs(&clock_shm->clock);
+  int error = posix_spawn(&children[pid], user_path, NULL, &spawn_attr, argv, environ);
+  if (error) {
+    errno = error;
+    perror("Failed to spawn user");
+    exit(EXIT_FAILURE);
+  }
+}
+
+/**
+ * Handles requests from every process in
+ * a shard that has rung the doorbell.
+ *
+ * Only visits processes whose pending bit is set.
+ *
+ * @param shard The shard
+ * @return      The number of processes with requests
+ */
+static int check_for_mem_requests(shard_t* shard) {
+  int num_pending = 0;
+  int last_word = (shard->first_pid + shard->num_pids - 1) / BITS_PER_WORD;
+  int word = shard->first_pid / BITS_PER_WORD;
+  pthread_mutex_lock(&shard->lock);
+  for (; word <= last_word; word++) {
+    unsigned long long mask = get_bitmap_range_mask(word,
+                                                    shard->first_pid,
+                                                    shard->num_pids);
+    unsigned long long bits = take_doorbell_word(&mem_rings->doorbell,
+                                                 word,
+                                                 mask);
+    while (bits) {
+      int pid = word * BITS_PER_WORD + __builtin_ctzll(bits);
+      bits &= bits - 1;
+      if (has_mem_request(pid)) {
+        drain_mem_requests(shard, pid);
+        num_pending++;
       }
-      if (verbose) print_page_table(i);
     }
   }
+  pthread_mutex_unlock(&shard->lock);
+  return num_pending;
 }
 
-static int has_mem_request(mem_op_t mem_op) {
-  return mem_op.addr != INIT_VAL;
+static int has_mem_request(int pid) {
+  return ring_has_submission(get_ring(mem_rings, pid));
 }
 
-static void handle_mem_request(int pid, mem_op_t* mem_op) {
-  int page_num = get_page_num(mem_op->addr);
+/**
+ * Handles every request in a process' submission
+ * queue, then wakes the process once for the whole batch.
+ *
+ * @param shard The shard that owns the process
+ * @param pid   Simulated PID of the process
+ */
+static void drain_mem_requests(shard_t* shard, int pid) {
+  mem_ring_t* ring = get_ring(mem_rings, pid);
+  mem_op_t mem_op;
+  mem_cqe_t cqe;
+  latency_sample_t samples[RING_SIZE];
+  int num_samples = 0;
+  probe_sample_t start;
+  while (ring_get_submission(ring, &mem_op)) {
+    if (num_samples == RING_SIZE) {
+      unsigned long long elapsed = shard->elapsed;
+      flush_shard_clock(shard);
+      record_latencies(pid, samples, num_samples, shard->flushed_at - elapsed);
+      num_samples = 0;
+    }
+    if (record_path != NULL) {
+      record_event(shard, pid, mem_op.op, mem_op.addr);
+    }
+    begin_phase(shard, &start);
+    handle_mem_request(shard, pid, &mem_op, &cqe);
+    end_phase(shard, PROBE_MEM_REQUEST, &start);
+    if (verbose) {
+      begin_phase(shard, &start);
+      print_page_table(pid);
+      end_phase(shard, PROBE_LOG, &start);
+    }
+    if (should_run_page_replacement(shard)) {
+      begin_phase(shard, &start);
+      run_page_replacement(shard);
+      end_phase(shard, PROBE_REPLACEMENT, &start);
+    }
+    if (verbose) {
+      begin_phase(shard, &start);
+      print_page_table(pid);
+      end_phase(shard, PROBE_LOG, &start);
+    }
+    ring_complete(ring, &cqe);
+    samples[num_samples].submit_time = mem_op.submit_time;
+    samples[num_samples].submit_real = mem_op.submit_real;
+    samples[num_samples].elapsed = shard->elapsed;
+    num_samples++;
+  }
+  unsigned long long elapsed = shard->elapsed;
+  flush_shard_clock(shard);
+  begin_phase(shard, &start);
+  sem_post(&ring->sem);
+  end_phase(shard, PROBE_WAKE, &start);
+  if (num_samples > 0) {
+    record_latencies(pid, samples, num_samples, shard->flushed_at - elapsed);
+  }
+}
 
-  int is_full = is_page_table_full(pid);
-  int is_in_memory = is_page_in_memory(pid, page_num);
+/**
+ * Records how long each request in a flushed batch took,
+ * in simulated and real time. Real time is read once for
+ * the whole batch, after its process was woken.
+ *
+ * @param pid         Simulated PID of the process
+ * @param samples     The batch's requests
+ * @param num_samples Number of requests in the batch
+ * @param batch_start Clock time the batch started at (ns)
+ */
+static void record_latencies(int pid,
+                             latency_sample_t* samples,
+                             int num_samples,
+                             unsigned long long batch_start) {
+  unsigned long long now = get_real_nanosecs();
+  int i = 0;
+  for (; i < num_samples; i++) {
+    latency_sample_t* sample = &samples[i];
+    unsigned long long completed = batch_start + sample->elapsed;
+    record_histogram(&stats[pid].sim_latency,
+                     completed > sample->submit_time
+                       ? completed - sample->submit_time : 0);
+    record_histogram(&stats[pid].real_latency,
+                     now > sample->submit_real ? now - sample->submit_real : 0);
+  }
+}
+
+/**
+ * Adds the time a shard has spent handling requests to the clock.
+ * Done once per batch so workers rarely contend for the clock.
+ *
+ * @param shard The shard
+ */
+static void flush_shard_clock(shard_t* shard) {
+  if (shard->elapsed == 0) {
+    return;
+  }
+  probe_sample_t start;
+  begin_phase(shard, &start);
+  shard->flushed_at = update_clock(&clock_shm->clock, shard->elapsed);
+  int has_been_a_second = has_crossed_second(shard->flushed_at, shard->elapsed);
+  end_phase(shard, PROBE_CLOCK, &start);
+  shard->elapsed = 0;
+  if (has_been_a_second && should_log_page_tables) {
+    begin_phase(shard, &start);
+    print_page_tables();
+    end_phase(shard, PROBE_LOG, &start);
+  }
+}
+
+/**
+ * Starts timing a phase if profiling.
+ * Costs one branch when not.
+ *
+ * @param shard The calling worker's shard
+ * @param start Set to the counters now
+ */
+static inline void begin_phase(shard_t* shard, probe_sample_t* start) {
+  if (__builtin_expect(shard->probes != NULL, 0)) {
+    begin_probe(shard->probes, start);
+  }
+}
+
+/**
+ * Adds the time since begin_phase to a phase if profiling.
+ *
+ * @param shard The calling worker's shard
+ * @param phase The phase that was timed
+ * @param start The counters begin_phase read
+ */
+static inline void end_phase(shard_t* shard, probe_phase phase, probe_sample_t* start) {
+  if (__builtin_expect(shard->probes != NULL, 0)) {
+    end_probe(shard->probes, phase, start);
+  }
+}
+
+/**
+ * Prints where each worker's time went, if profiling.
+ * The workers must have stopped.
+ */
+static void print_probe_report() {
+  if (!should_profile) {
+    return;
+  }
+  probes_t total;
+  memset(&total, 0, sizeof(total));
+  int i = 0;
+  for (; i < num_workers; i++) {
+    merge_probes(&total, shards[i].probes);
+  }
+  fprintf(stderr, "Time spent handling requests (%d workers):\n", num_workers);
+  print_probes(stderr, &total);
+}
+
+static void handle_mem_request(shard_t* shard,
+                               int pid,
+                               mem_op_t* mem_op,
+                               mem_cqe_t* cqe) {
+  long long page_num = get_page_num(mem_op->addr);
+  if (page_num < 0 || page_num >= geometry.num_proc_pages) {
+    log_ints(log, "PID %d referenced an address outside its address space\n\n",
+             pid, 0, 0);
+    cqe->page_num = -1;
+    cqe->page_fault = 0;
+    return;
+  }
+
+  // A TLB hit skips the page table walk
+  page* pg = lookup_tlbs(pid, page_num);
 
   print_received_memory_request(mem_op->op, pid, page_num);
 
-  page* pg;
-  if (is_in_memory) {  // Set valid bit to 1
-    int i = find_page(pid, page_num);
-    pg = get_page(page_tables, pid, i);
-    int has_been_a_second = update_clock(clock_shm, 10);
-    if (has_been_a_second && !verbose) {
-      print_page_tables();
-    }
-  } else if (!is_full && !is_in_memory) {  // Set frame number
-    int i = get_next_available_page_table_index(pid);
-    pg = get_page(page_tables, pid, i);
-    pg->num = page_num;
-    int k = pid * NUM_FRAMES + i;
-    unallocated_frames[k] = 1;
-    unsigned int fifteen_millisecs = 15 * NANOSECS_PER_MILLISEC;
-    int has_been_a_second = update_clock(clock_shm, fifteen_millisecs);
-    if (has_been_a_second  && !verbose) {
-      print_page_tables();
-    }
-    stats[pid].num_page_faults++;
-  }
-  pg->valid = 1;
+  cqe->page_num = page_num;
+  cqe->page_fault = 0;
+
+  if (pg != NULL) {
+    replacement_access(shard->replacement, pg->num - shard->first_frame);
+    shard->elapsed += TLB_HIT_NANOSECS;
+    stats[pid].num_tlb_hits++;
+    if (pg->huge) stats[pid].num_huge_tlb_hits++;
+  } else {
+    pg = get_page(page_tables, pid, page_num, &shard->free_nodes);
+    if (pg->valid) {
+      replacement_access(shard->replacement, pg->num - shard->first_frame);
+      shard->elapsed += PAGE_HIT_NANOSECS;
+    } else {
+      pg = handle_page_fault(shard, pid, page_num, pg);
+      stats[pid].num_page_faults++;
+      cqe->page_fault = 1;
+    }
+    insert_tlbs(pid, page_num, pg);
+  }
+
+  if (pg->read_ahead) {
+    use_readahead_page(shard, pid, page_num, pg);
+  }
 
   if (mem_op->op == WRITE) {
     pg->dirty = 1;
   }
 
-  mem_op->addr = INIT_VAL;
   stats[pid].num_mem_accesses++;
-  sem_post(mem_sem_ids[pid]);
 }
 
-static void print_received_memory_request(io_op op, int pid, int page_num) {
-  if (verbose) {
-    char* op_str = op == READ ? "read" : "write";
-    fprintf(log,
-            "Received PID %d request to %s page %d\n\n",
-            pid,
-            op_str,
-            page_num);
+/**
+ * Looks a page up in a process' huge page TLB, then its base page TLB.
+ *
+ * @return The page's entry, or NULL on a miss
+ */
+static page* lookup_tlbs(int pid, long long page_num) {
+  if (tlbs == NULL) {
+    return NULL;
+  }
+  if (huge_tlbs != NULL) {
+    page* first = tlb_lookup(huge_tlbs[pid], page_num >> geometry.huge_page_shift);
+    if (first != NULL) {
+      return first + (page_num & (geometry.huge_page_pages - 1));
+    }
+  }
+  return tlb_lookup(tlbs[pid], page_num);
+}
+
+/**
+ * Adds a translation that missed to the TLB for its page's size.
+ * A huge page's translation is to the entry of its first page.
+ */
+static void insert_tlbs(int pid, long long page_num, page* pg) {
+  if (huge_tlbs != NULL && pg->huge) {
+    tlb_insert(huge_tlbs[pid],
+               page_num >> geometry.huge_page_shift,
+               get_huge_region(pg, page_num));
+  } else if (tlbs != NULL) {
+    tlb_insert(tlbs[pid], page_num, pg);
   }
 }
 
-static int is_page_in_memory(int pid, int page_num) {
-  page* pg = get_page(page_tables, pid, 0);
-  int is_in_memory = 0;
+/**
+ * Loads a page that faulted. With huge pages, a fault in a region
+ * none of whose pages are loaded loads the whole region as a huge
+ * page if there is a free run of frames for it. Otherwise the page
+ * is loaded alone, beside the rest of its region where possible,
+ * and the region is promoted once it is full.
+ *
+ * The fault takes as long as the swap device takes to read the
+ * pages in, behind whatever it has queued. A page still in the
+ * writeback buffer is taken back without a read.
+ *
+ * @param  shard    The shard that owns the process
+ * @param  pid      Simulated PID of the process
+ * @param  page_num The page
+ * @param  pg       Its entry, from get_page
+ * @return          Its entry, which may have moved
+ */
+static page* handle_page_fault(shard_t* shard, int pid, long long page_num, page* pg) {
+  unsigned long long fault_time;
+  if (geometry.huge_page_pages > 0 && load_huge_page(shard, pid, page_num, pg)) {
+    long long first_page = page_num - (pg - get_huge_region(pg, page_num));
+    fault_time = swap_read(&shard->swap,
+                           get_swap_block(pid, first_page),
+                           geometry.huge_page_pages,
+                           get_shard_time(shard));
+    shard->elapsed += fault_time;
+    stats[pid].fault_nanosecs += fault_time;
+    stats[pid].num_huge_faults++;
+    return pg;
+  }
+  if (is_memory_full(shard)) {
+    evict_page(shard);  // Make room on demand
+    // The eviction may have freed the page's leaf
+    pg = get_page(page_tables, pid, page_num, &shard->free_nodes);
+  }
+  map_page(shard, pid, page_num, pg);
+
+  long long block = get_swap_block(pid, page_num);
+  if (reclaim_writeback(&shard->swap, block)) {
+    pg->dirty = 1;  // It was never written
+    fault_time = PAGE_HIT_NANOSECS;
+  } else {
+    fault_time = swap_read(&shard->swap, block, 1, get_shard_time(shard));
+  }
+  shard->elapsed += fault_time;
+  stats[pid].fault_nanosecs += fault_time;
+
+  if (geometry.huge_page_pages > 0) {
+    promote_if_contiguous(shard, pid, page_num, pg);
+  }
+  if (readaheads != NULL && observe_fault(readaheads + pid, page_num)) {
+    read_ahead(shard, pid);
+  }
+  return pg;
+}
+
+/**
+ * Loads a base page into a free frame, beside the rest
+ * of its region where possible, and tells the replacement
+ * policy about it.
+ */
+static void map_page(shard_t* shard, int pid, long long page_num, page* pg) {
+  int hint = geometry.huge_page_pages > 0 ? get_region_frame(shard, pg, page_num)
+                                          : NO_FRAME;
+  load_page(page_tables, pg, get_next_available_frame(shard, pid, page_num, hint));
+  replacement_insert(shard->replacement,
+                     pg->num - shard->first_frame,
+                     get_page_key(shard, pid, page_num));
+}
+
+/**
+ * Reads the next batch of a process' stream into free frames.
+ * The reads are queued on the swap device behind the fault that
+ * set them off, which does not wait for them. Resident pages are
+ * skipped, and the batch ends early at the end of the address
+ * space or when no frame is free, since reading ahead never
+ * evicts. Nothing is read while the device's queue is full.
+ *
+ * @param shard The shard that owns the process
+ * @param pid   Simulated PID of the process
+ */
+static void read_ahead(shard_t* shard, int pid) {
+  readahead_t* ra = readaheads + pid;
+  unsigned long long now = get_shard_time(shard);
+  if (is_swap_congested(&shard->swap, now)) {
+    return;
+  }
+  unsigned long long ready_at = now;
+  long long run_block = 0;  // First block of adjacent pages still to read
+  int run_length = 0;
+  long long page_num = ra->next_page;
   int i = 0;
-  for (; i < NUM_FRAMES; i++) {
-    if ((pg + i)->num == page_num) {
-      is_in_memory = 1;
+  for (; i < ra->window; i++, page_num += ra->stride) {
+    if (page_num < 0 || page_num >= geometry.num_proc_pages || is_memory_full(shard)) {
+      break;
+    }
+    page* pg = get_page(page_tables, pid, page_num, &shard->free_nodes);
+    if (pg->valid) {
+      continue;
+    }
+    map_page(shard, pid, page_num, pg);
+    pg->read_ahead = 1;
+    add_unused_readahead(shard, pg->num - shard->first_frame);
+    stats[pid].num_readaheads++;
+
+    long long block = get_swap_block(pid, page_num);
+    if (run_length > 0 && block != run_block + run_length) {
+      ready_at = swap_read_ahead(&shard->swap, run_block, run_length, now);
+      run_length = 0;
+    }
+    if (reclaim_writeback(&shard->swap, block)) {
+      pg->dirty = 1;  // It was never written
+    } else if (run_length++ == 0) {
+      run_block = block;
     }
+    if (geometry.huge_page_pages > 0) {
+      promote_if_contiguous(shard, pid, page_num, pg);
+    }
+  }
+  if (run_length > 0) {
+    ready_at = swap_read_ahead(&shard->swap, run_block, run_length, now);
+  }
+  if (verbose) {
+    log_printf(log,
+               "Read ahead PID %d pages %lld-%lld by %lld\n\n",
+               pid,
+               ra->next_page,
+               page_num - ra->stride,
+               ra->stride);
   }
-  return is_in_memory;
+  record_readahead_batch(ra, page_num, ready_at);
 }
 
-static int is_page_table_full(int pid) {
-  page* pg = get_page(page_tables, pid, 0);
-  int is_full = 1;
-  int i = 0;
-  for (; i < NUM_FRAMES; i++) {
-    if ((pg + i)->num == INIT_VAL) {
-      is_full = 0;
+/**
+ * The first use of a page that was read ahead waits for it to
+ * arrive, if it has not yet, and reads the next batch of its
+ * stream once the process reaches the last one.
+ */
+static void use_readahead_page(shard_t* shard, int pid, long long page_num, page* pg) {
+  readahead_t* ra = readaheads + pid;
+  pg->read_ahead = 0;
+  stats[pid].num_readahead_hits++;
+  unsigned long long ready_at = get_readahead_ready(ra, page_num);
+  unsigned long long now = get_shard_time(shard);
+  if (ready_at > now) {
+    shard->elapsed += ready_at - now;
+  }
+  if (observe_readahead_use(ra, page_num)) {
+    read_ahead(shard, pid);
+  }
+}
+
+/**
+ * Remembers a frame that was read ahead, so it is evicted
+ * before any other if it is still unused. When the shard
+ * remembers as many as it has frames, the oldest is forgotten.
+ *
+ * @param frame The frame, numbered from the shard's first
+ */
+static void add_unused_readahead(shard_t* shard, int frame) {
+  int slot = shard->first_unused_readahead + shard->num_unused_readaheads;
+  if (slot >= shard->num_frames) {
+    slot -= shard->num_frames;
+  }
+  shard->unused_readaheads[slot] = frame;
+  if (shard->num_unused_readaheads < shard->num_frames) {
+    shard->num_unused_readaheads++;
+  } else if (++shard->first_unused_readahead == shard->num_frames) {
+    shard->first_unused_readahead = 0;
+  }
+}
+
+/**
+ * Takes the newest frame read ahead that still holds a page
+ * nothing has used, skipping frames used or freed since.
+ * The newest is furthest ahead of its stream, so it would
+ * be used last.
+ *
+ * @return The frame, numbered from the shard's first,
+ *         or NO_VICTIM if there is none
+ */
+static int take_unused_readahead(shard_t* shard) {
+  while (shard->num_unused_readaheads > 0) {
+    int slot = shard->first_unused_readahead + --shard->num_unused_readaheads;
+    if (slot >= shard->num_frames) {
+      slot -= shard->num_frames;
+    }
+    int frame = shard->unused_readaheads[slot];
+    frame_t* owner = frame_table + shard->first_frame + frame;
+    if (owner->pid == NO_OWNER) {
+      continue;
+    }
+    page* pg = find_page(page_tables, owner->pid, owner->page_num);
+    if (pg != NULL && pg->valid && pg->read_ahead) {
+      return frame;
     }
   }
-  return is_full;
+  return NO_VICTIM;
 }
 
-static int get_next_available_page_table_index(int pid) {
-  page* pg;
-  int i = 0;
+/**
+ * @return The swap device block a page is stored in.
+ *         Each process' pages are adjacent.
+ */
+static long long get_swap_block(int pid, long long page_num) {
+  return pid * geometry.num_proc_pages + page_num;
+}
 
-  do {
-    pg = get_page(page_tables, pid, i);
-    i++;
-  } while (pg->num != INIT_VAL && i < NUM_FRAMES);
-  
-  return --i;
+/**
+ * @return The shard's simulated time (in nanoseconds),
+ *         counting time not yet added to the clock
+ */
+static unsigned long long get_shard_time(shard_t* shard) {
+  return get_clock_nanosecs(&clock_shm->clock) + shard->elapsed;
+}
+
+/**
+ * Loads every page of an unloaded region into a free run of
+ * frames aligned to the huge page size, as one huge page.
+ *
+ * @return 1 if it was loaded. 0 if some of the region is loaded,
+ *         it runs past the address space or there is no free run.
+ */
+static int load_huge_page(shard_t* shard, int pid, long long page_num, page* pg) {
+  int num_pages = geometry.huge_page_pages;
+  page* first = get_huge_region(pg, page_num);
+  long long first_page = page_num - (pg - first);
+  if (first_page + num_pages > geometry.num_proc_pages || !is_region_unloaded(first)) {
+    return 0;
+  }
+  int run = find_free_run(&shard->frames, num_pages);
+  if (run == NO_FRAME) {
+    return 0;
+  }
+  allocate_frames(&shard->frames, run, num_pages);
+  int i = 0;
+  for (; i < num_pages; i++) {
+    int frame = shard->first_frame + run + i;
+    frame_table[frame].pid = pid;
+    frame_table[frame].page_num = first_page + i;
+    load_page(page_tables, first + i, frame);
+    replacement_insert(shard->replacement,
+                       run + i,
+                       get_page_key(shard, pid, first_page + i));
+  }
+  promote_region(first);
+  return 1;
 }
 
-static int find_page(int pid, int frame_number) {
+/**
+ * Finds the frame that would put a page beside the loaded pages
+ * of its region, in a run of frames aligned to the huge page size.
+ *
+ * @return The frame, numbered from the shard's first,
+ *         or NO_FRAME if there is none or it is allocated
+ */
+static int get_region_frame(shard_t* shard, page* pg, long long page_num) {
+  int num_pages = geometry.huge_page_pages;
+  page* first = get_huge_region(pg, page_num);
   int i = 0;
-  page* pg = get_page(page_tables, pid, 0);
-  for (; i < NUM_FRAMES; i++) {
-    if ((pg + i)->num == frame_number) {
-      return i;
+  for (; i < num_pages; i++) {
+    if (first[i].valid) {
+      long long run = (long long) first[i].num - shard->first_frame - i;
+      if (run < 0 || run % num_pages != 0 || run + num_pages > shard->num_frames) {
+        return NO_FRAME;
+      }
+      int frame = run + (pg - first);
+      return is_frame_allocated(&shard->frames, frame) ? NO_FRAME : frame;
+    }
+  }
+  return NO_FRAME;
+}
+
+/**
+ * Promotes a page's region to a huge page if every page of it
+ * is loaded in a run of frames aligned to the huge page size.
+ * The base page TLB's translations for the region are dropped.
+ */
+static void promote_if_contiguous(shard_t* shard, int pid, long long page_num, page* pg) {
+  int num_pages = geometry.huge_page_pages;
+  page* first = get_huge_region(pg, page_num);
+  if (!is_region_contiguous(first) ||
+      (first->num - shard->first_frame) % num_pages != 0) {
+    return;
+  }
+  promote_region(first);
+  stats[pid].num_promotions++;
+  long long first_page = page_num - (pg - first);
+  if (tlbs != NULL) {
+    int i = 0;
+    for (; i < num_pages; i++) {
+      tlb_invalidate(tlbs[pid], first_page + i);
     }
   }
-  return -1;
+  if (verbose) {
+    log_printf(log,
+               "Promoted PID %d pages %lld-%lld to a huge page\n\n",
+               pid,
+               first_page,
+               first_page + num_pages - 1);
+  }
+}
+
+/**
+ * Splits the huge page holding a page back into base pages,
+ * so the page can be evicted alone.
+ */
+static void demote_huge_page(int pid, long long page_num, page* pg) {
+  demote_region(get_huge_region(pg, page_num));
+  stats[pid].num_demotions++;
+  if (huge_tlbs != NULL) {
+    tlb_invalidate(huge_tlbs[pid], page_num >> geometry.huge_page_shift);
+  }
+}
+
+static void print_received_memory_request(io_op op, int pid, long long page_num) {
+  if (verbose) {
+    log_printf(log,
+               "Received PID %d request to %s page %lld\n\n",
+               pid,
+               op == READ ? "read" : "write",
+               page_num);
+  }
+}
+
+static int is_memory_full(shard_t* shard) {
+  return count_allocated_frames(&shard->frames, 0, shard->num_frames)
+         == shard->num_frames;
+}
+
+/**
+ * Allocates a frame from a shard's pool
+ * and records its owner in the inverted page table.
+ *
+ * @param shard    The shard that owns the process
+ * @param pid      Simulated PID of the owner
+ * @param page_num Page number loaded into the frame
+ * @param hint     A free frame to take, numbered from the
+ *                 shard's first, or NO_FRAME for the lowest free one
+ * @return         The frame, or NO_FRAME if every frame is allocated
+ */
+static int get_next_available_frame(shard_t* shard,
+                                    int pid,
+                                    long long page_num,
+                                    int hint) {
+  int frame = hint;
+  if (frame != NO_FRAME) {
+    allocate_frames(&shard->frames, frame, 1);
+  } else {
+    frame = allocate_frame(&shard->frames, 0, shard->num_frames);
+  }
+  if (frame == NO_FRAME) {
+    return NO_FRAME;
+  }
+  frame += shard->first_frame;
+  frame_table[frame].pid = pid;
+  frame_table[frame].page_num = page_num;
+  return frame;
+}
+
+static void release_frame(shard_t* shard, int frame) {
+  free_frame(&shard->frames, frame - shard->first_frame);
+  frame_table[frame].pid = NO_OWNER;
+}
+
+/**
+ * Keys identify pages across every process in a shard. When there
+ * are more pages than MAX_PAGE_KEYS, some pages share a key, and
+ * ARC may mistake one for another it recently evicted.
+ *
+ * @return A key for a page
+ */
+static int get_page_key(shard_t* shard, int pid, long long page_num) {
+  long long key = (pid - shard->first_pid) * geometry.num_proc_pages + page_num;
+  return key % shard->num_keys;
 }
 
 static void print_page_tables() {
   print_time();
   int i = 0;
-  for (; i < MAX_PROCS; i++) {
+  for (; i < geometry.max_procs; i++) {
     print_page_table(i);
   } 
 }
 
 static void print_time() {
-  fprintf(log, "Current Time: %d:%d\n\n", clock_shm->secs, clock_shm->nanosecs);
+  unsigned long long now = get_clock_nanosecs(&clock_shm->clock);
+  log_ints(log,
+           "Current Time: %d:%d\n\n",
+           get_secs(now),
+           get_subsec_nanosecs(now),
+           0);
 }
 
+/**
+ * Logs a snapshot of a process' page table.
+ * The log writer formats it.
+ *
+ * Only pages in leaves of the table are logged. A single
+ * level table with no leaf is logged as every page unloaded.
+ *
+ * @param pid Simulated PID of the process
+ */
 static void print_page_table(int pid) {
-  fprintf(log, "Process %d Page Table\n", pid);
+  long long num_pages = 0;
+  for_each_leaf(page_tables, pid, count_leaf_pages, &num_pages);
+  int is_unused_flat_table = num_pages == 0 && geometry.num_levels == 1;
+  if (is_unused_flat_table) {
+    num_pages = geometry.num_proc_pages;
+  }
+  int num_logged = num_pages < MAX_LOGGED_PAGES ? num_pages : MAX_LOGGED_PAGES;
+
+  page_table_record_t* record =
+    reserve_log_record(log,
+                       format_page_table,
+                       sizeof(page_table_record_t) +
+                       sizeof(logged_page_t) * num_logged);
+  if (record == NULL) {
+    return;
+  }
+  record->pid = pid;
+  record->num_pages = 0;
+  record->num_omitted = num_pages - num_logged;
+  if (is_unused_flat_table) {
+    for (; record->num_pages < num_logged; record->num_pages++) {
+      record->pages[record->num_pages].num = record->num_pages;
+      reset_page(&record->pages[record->num_pages].pg);
+    }
+  } else {
+    for_each_leaf(page_tables, pid, copy_leaf_pages, record);
+  }
+  commit_log_record(log, record);
+}
 
+static void count_leaf_pages(long long first_page,
+                             page* pages,
+                             int num_pages,
+                             void* arg) {
+  *(long long*) arg += num_pages;
+}
+
+/**
+ * Copies a page table leaf's pages into a snapshot,
+ * up to MAX_LOGGED_PAGES.
+ *
+ * @param arg The snapshot
+ */
+static void copy_leaf_pages(long long first_page,
+                            page* pages,
+                            int num_pages,
+                            void* arg) {
+  page_table_record_t* record = arg;
   int i = 0;
-  fprintf(log, "| ");
+  for (; i < num_pages && record->num_pages < MAX_LOGGED_PAGES; i++) {
+    logged_page_t* logged = &record->pages[record->num_pages++];
+    logged->num = first_page + i;
+    logged->pg = pages[i];
+  }
+}
+
+/**
+ * Writes out a page table snapshot. Called by the log writer.
+ * Multi-level tables show the range of each run of pages.
+ */
+static void format_page_table(FILE* out, const void* data) {
+  const page_table_record_t* record = data;
+  fprintf(out, "Process %d Page Table\n", record->pid);
+  if (record->num_pages == 0) {
+    fprintf(out, "No pages touched\n\n");
+  }
+
+  int first = 0;
+  while (first < record->num_pages) {
+    int end = first + 1;
+    while (end < record->num_pages &&
+           record->pages[end].num == record->pages[end - 1].num + 1) {
+      end++;
+    }
+    if (geometry.num_levels > 1) {
+      fprintf(out,
+              "Pages %lld-%lld\n",
+              record->pages[first].num,
+              record->pages[end - 1].num);
+    }
+    format_page_table_rows(out, record->pages + first, end - first);
+    first = end;
+  }
+
+  if (record->num_omitted > 0) {
+    fprintf(out, "%lld more pages not shown\n\n", record->num_omitted);
+  }
+}
+
+/**
+ * Writes out the frames and bits of a run of pages.
+ */
+static void format_page_table_rows(FILE* out,
+                                   const logged_page_t* pages,
+                                   int num_pages) {
+  int i = 0;
+  fprintf(out, "| ");
 
   do {
-    page* pg = get_page(page_tables, pid, i);
-    if (pg->num == INIT_VAL) {
-      fprintf(log, "--");
+    const page* pg = &pages[i].pg;
+    if (pg->num == NOT_LOADED) {
+      fprintf(out, "---");
     } else {
-      fprintf(log, "%02d", pg->num);
+      fprintf(out, "%03d", pg->num);
     }
-    fprintf(log, " | ");
+    fprintf(out, " | ");
     i++;
-  } while (i < NUM_FRAMES);
+  } while (i < num_pages);
 
-  fprintf(log, "\n");
+  fprintf(out, "\n");
 
   int k = 0;
-  fprintf(log, "| ");
+  fprintf(out, "| ");
 
   do {
-    page* pg = get_page(page_tables, pid, k);
+    const page* pg = &pages[k].pg;
     char* display_symbol;
-    if (pg->valid && pg->dirty) {
-      display_symbol = "*D";
+    if (pg->huge) {
+      display_symbol = pg->dirty ? "*DH" : "*-H";
+    } else if (pg->read_ahead) {
+      display_symbol = pg->dirty ? "*DR" : "*-R";
+    } else if (pg->valid && pg->dirty) {
+      display_symbol = "*D ";
     } else if (pg->valid && !pg->dirty) {
-      display_symbol = "*-";
+      display_symbol = "*- ";
     } else if (!pg->valid && pg->dirty) {
-      display_symbol = "-D";
+      display_symbol = "-D ";
     } else {
-      display_symbol = "--";
+      display_symbol = "---";
     }
-    fprintf(log, "%s | ", display_symbol);
+    fprintf(out, "%s | ", display_symbol);
     k++;
-  } while (k < NUM_FRAMES);
+  } while (k < num_pages);
 
-  fprintf(log, "\n\n");
+  fprintf(out, "\n\n");
 }
 
 /**
- * Allocates semaphores for
- * making memory references with
- * an initial value of 0.
+ * Runs every simulated process as a state machine inside oss,
+ * with each worker running the processes in its shard.
  */
-static void setup_mem_sems() {
+static void run_sim_procs() {
+  sim_procs = allocate(sizeof(sim_proc_t) * geometry.max_procs);
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  start_workers(simulate_shard);
+  join_workers();
+
+  unsigned long long mem_accesses = 0;
   int i = 0;
-  for (; i < MAX_PROCS; i++) {
-    int sem_flags = IPC_CREAT | IPC_EXCL | S_IRUSR | S_IWUSR;
-    mem_sem_ids[i] = allocate_sem(IPC_PRIVATE, sem_flags);
-    init_sem(mem_sem_ids[i], 0);
+  for (i = 0; i < geometry.max_procs; i++) {
+    mem_accesses += stats[i].num_mem_accesses;
   }
+  print_rate("Simulated", "references", mem_accesses, &start);
+
+  // Processes still running at the timer interrupt
+  for (i = 0; i < geometry.max_procs; i++) {
+    handle_process_exit(i);
+  }
+  free(sim_procs);
 }
 
 /**
- * Deallocate semaphores for
- * making memory references.
+ * Runs a shard's simulated processes.
+ *
+ * Each round, every running process reaps its completions and
+ * fills its ring the same way user does, then the worker handles
+ * the requests. There are no system calls or context switches
+ * per reference. Stops at the timer interrupt or once every
+ * process has terminated.
+ *
+ * @param arg The shard
  */
-static void deallocate_mem_sems() {
+static void* simulate_shard(void* arg) {
+  shard_t* shard = arg;
+  if (shard->probes) open_probes(shard->probes);
+  int end_pid = shard->first_pid + shard->num_pids;
+  int num_running = 0;
+  int pid = shard->first_pid;
+  for (; pid < end_pid; pid++) {
+    start_sim_proc(shard, pid);
+    num_running++;
+  }
+
+  while (should_run && num_running > 0) {
+    for (pid = shard->first_pid; pid < end_pid; pid++) {
+      if (children[pid] != INIT_VAL && !step_sim_proc(pid)) {
+        handle_process_exit(pid);
+        num_running--;
+      }
+    }
+    check_for_mem_requests(shard);
+  }
+  if (shard->probes) close_probes(shard->probes);
+  return NULL;
+}
+
+/**
+ * Starts a simulated process, charging its creation time to the clock.
+ *
+ * @param shard The shard that owns the process
+ * @param pid   Simulated PID of the process
+ */
+static void start_sim_proc(shard_t* shard, int pid) {
+  sim_proc_t* proc = sim_procs + pid;
+  stats[pid].start_time = get_clock_nanosecs(&clock_shm->clock);
+  init_workload(&proc->workload,
+                &workload_config,
+                get_proc_seed(pid),
+                geometry.proc_mem,
+                geometry.page_size);
+  proc->num_in_flight = 0;
+  shard->elapsed += get_creation_time(&proc->workload);
+  flush_shard_clock(shard);
+}
+
+/**
+ * Advances a simulated process by one batch of requests.
+ *
+ * @param pid Simulated PID of the process
+ * @return    0 once the process has terminated. 1 otherwise.
+ */
+static int step_sim_proc(int pid) {
+  sim_proc_t* proc = sim_procs + pid;
+  mem_ring_t* ring = get_ring(mem_rings, pid);
+
+  proc->num_in_flight -= ring_reap_all(ring);
+  proc->num_in_flight += submit_mem_requests(&proc->workload,
+                                             ring,
+                                             proc->num_in_flight,
+                                             &clock_shm->clock);
+  if (proc->num_in_flight == 0) {
+    return 0;
+  }
+  ring_doorbell(&mem_rings->doorbell, pid);
+  return 1;
+}
+
+/**
+ * Runs simulated processes as discrete events, in order of
+ * simulated time, on one thread. A process makes its next
+ * reference once its last one completes, so while one waits
+ * on the swap device others run. A process that terminates
+ * is replaced in its PID by a new one. Runs until the -D
+ * limit however long that takes, and with the same seed
+ * handles the same events in the same order every time.
+ */
+static void run_events() {
+  sim_procs = allocate(sizeof(sim_proc_t) * geometry.max_procs);
+  event_queue_t queue;
+  init_event_queue(&queue, geometry.max_procs);
+
+  unsigned long long now = get_clock_nanosecs(&clock_shm->clock);
+  unsigned long long end_time = event_time_limit ? now + event_time_limit
+                                                 : ULLONG_MAX;
+  int pid = 0;
+  for (; pid < geometry.max_procs; pid++) {
+    children[pid] = INIT_VAL;  // Until it arrives
+    push_event(&queue, now + create_event_proc(pid), pid, EVENT_ARRIVAL);
+  }
   int i = 0;
-  for (; i < MAX_PROCS; i++) {
-    deallocate_sem(mem_sem_ids[i]);
+  for (; i < num_workers; i++) {
+    if (shards[i].probes) open_probes(shards[i].probes);
+  }
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  unsigned long long num_events = 0;
+  unsigned long long num_references = 0;
+  for (;;) {
+    const event_t* event = peek_event(&queue);
+    if (event->time > end_time ||
+        (event_reference_limit && num_references == event_reference_limit)) {
+      break;
+    }
+    num_events++;
+    now = event->time;
+    pid = event->pid;
+    set_clock_nanosecs(&clock_shm->clock, now);
+    switch (event->kind) {
+      case EVENT_ARRIVAL:
+        recycle_proc_slot(pid);
+        reschedule_first_event(&queue, now, EVENT_REFERENCE);
+        break;
+      case EVENT_REFERENCE:
+      case EVENT_FAULT_DONE:
+        num_references += simulate_reference(&queue, pid, now);
+        break;
+      case EVENT_EXIT:
+        handle_process_exit(pid);
+        reschedule_first_event(&queue, now + create_event_proc(pid), EVENT_ARRIVAL);
+        break;
+    }
+  }
+
+  for (i = 0; i < num_workers; i++) {
+    if (shards[i].probes) close_probes(shards[i].probes);
+  }
+  print_rate("Handled", "events", num_events, &start);
+  print_rate("Simulated", "references", num_references, &start);
+
+  // Processes still running at the limit
+  for (pid = 0; pid < geometry.max_procs; pid++) {
+    handle_process_exit(pid);
   }
+  destroy_event_queue(&queue);
+  free(sim_procs);
 }
 
 /**
- * Allocates a semaphore for protecting
- * the logical clock with an initial
- * value of 1.
+ * Makes up the next process to run in a PID.
+ *
+ * @param pid Simulated PID of the process
+ * @return    Time it takes to create (in nanoseconds)
+ */
+static unsigned int create_event_proc(int pid) {
+  sim_proc_t* proc = sim_procs + pid;
+  init_workload(&proc->workload,
+                &workload_config,
+                get_proc_seed(num_procs_started++),
+                geometry.proc_mem,
+                geometry.page_size);
+  return get_creation_time(&proc->workload);
+}
+
+/**
+ * Handles a process' next memory reference, then schedules
+ * its next one for when this one completes. A process that
+ * has decided to terminate exits instead.
+ *
+ * @param queue The event queue, with the process' event first
+ * @param pid   Simulated PID of the process
+ * @param now   Simulated time of the reference (in nanoseconds)
+ * @return      1 if a reference was made. 0 otherwise.
  */
-static void setup_clock_sem() {
-  int sem_flags = IPC_CREAT | IPC_EXCL | S_IRUSR | S_IWUSR;
-  clock_sem_id = allocate_sem(IPC_PRIVATE, sem_flags);
-  init_sem(clock_sem_id, 1);
+static int simulate_reference(event_queue_t* queue, int pid, unsigned long long now) {
+  sim_proc_t* proc = sim_procs + pid;
+  mem_op_t mem_op;
+  if (!get_next_request(&proc->workload, &mem_op)) {
+    reschedule_first_event(queue, now, EVENT_EXIT);
+    return 0;
+  }
+  shard_t* shard = get_shard(pid);
+  if (record_path != NULL) {
+    record_event(shard, pid, mem_op.op, mem_op.addr);
+  }
+  probe_sample_t start;
+  mem_cqe_t cqe;
+  begin_phase(shard, &start);
+  handle_mem_request(shard, pid, &mem_op, &cqe);
+  end_phase(shard, PROBE_MEM_REQUEST, &start);
+  if (should_run_page_replacement(shard)) {
+    begin_phase(shard, &start);
+    run_page_replacement(shard);
+    end_phase(shard, PROBE_REPLACEMENT, &start);
+  }
+  if (verbose) {
+    begin_phase(shard, &start);
+    print_page_table(pid);
+    end_phase(shard, PROBE_LOG, &start);
+  }
+
+  // The clock is the event's time, so the shard's
+  // elapsed time is how long this reference took
+  unsigned long long latency = shard->elapsed;
+  shard->elapsed = 0;
+  record_histogram(&stats[pid].sim_latency, latency);
+  reschedule_first_event(queue,
+                         now + latency,
+                         cqe.page_fault ? EVENT_FAULT_DONE : EVENT_REFERENCE);
+  return 1;
+}
+
+/**
+ * Prints how fast a run went to stderr.
+ *
+ * @param verb  What was done, such as "Replayed"
+ * @param noun  What was counted, such as "records"
+ * @param count How many were done
+ * @param start Monotonic time the run started
+ */
+static void print_rate(char* verb,
+                       char* noun,
+                       unsigned long long count,
+                       struct timespec* start) {
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double secs = (end.tv_sec - start->tv_sec) +
+                (end.tv_nsec - start->tv_nsec) / (double) NANOSECS_PER_SEC;
+  fprintf(stderr,
+          "%s %llu %s in %.3f seconds (%.2f million per second)\n",
+          verb,
+          count,
+          noun,
+          secs,
+          secs > 0 ? count / secs / 1e6 : 0);
+}
+
+/**
+ * @param start Monotonic time something started
+ * @return      Nanoseconds since then
+ */
+static unsigned long long get_elapsed_nanosecs(struct timespec* start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * NANOSECS_PER_SEC +
+         now.tv_nsec - start->tv_nsec;
+}
+
+static void terminate_children() {
+  int i = 0;
+  for (; i < geometry.max_procs; i++) {
+    if (children[i] > 0) {
+      kill(children[i], SIGTERM);
+    }
+  }
 }
 
 static void wait_for_all_children() {
   pid_t pid;
-  while ((pid = waitpid(-1, NULL, 0))) {
-    if (errno == ECHILD) {
-      break;
-    }
+  while ((pid = waitpid(-1, NULL, 0)) > 0) {
+    handle_process_exit(find_child(pid));
   }
 }
 
-static void setup_mem_ops(mem_op_t* mem_ops) {
+/**
+ * Checks a trace was recorded in the geometry it is
+ * replayed in, and says how it was recorded if not.
+ *
+ * @param  header The trace's header
+ * @return        1 if it was. 0 otherwise.
+ */
+static int matches_trace_geometry(const trace_header_t* header) {
+  int matches = header->proc_mem == geometry.proc_mem &&
+                header->page_size == geometry.page_size &&
+                header->num_levels == geometry.num_levels &&
+                header->huge_page_pages == geometry.huge_page_pages;
   int i = 0;
-  for (; i < MAX_PROCS; i++) {
-    mem_ops[i].addr = INIT_VAL;
+  for (; matches && i < header->num_levels; i++) {
+    matches = header->level_bits[i] == geometry.level_bits[i];
+  }
+  if (matches) {
+    return 1;
+  }
+  fprintf(stderr,
+          "Trace was recorded with -s %u -a %llu, %d page table levels (",
+          header->page_size,
+          header->proc_mem,
+          header->num_levels);
+  for (i = 0; i < header->num_levels; i++) {
+    fprintf(stderr, "%s%d", i ? "," : "", header->level_bits[i]);
+  }
+  fprintf(stderr, " bits) and ");
+  if (header->huge_page_pages) {
+    fprintf(stderr, "-H %d.", header->huge_page_pages);
+  } else {
+    fprintf(stderr, "no huge pages.");
+  }
+  fprintf(stderr, " Replay it with the same.\n");
+  return 0;
+}
+
+static void start_recording() {
+  if (open_trace_writer(&trace_writer, record_path, geometry.max_procs) == -1) {
+    free_shm();
+    exit(EXIT_FAILURE);
   }
 }
 
-static int should_run_page_replacement(int pid) {
-  int frames_allocated = 0;
+/**
+ * Appends an event to the trace being recorded,
+ * stamped with the current simulated time.
+ *
+ * @param shard The shard that owns the process
+ * @param pid   Simulated PID of the process
+ * @param kind  Read, write or exit
+ * @param addr  Address of a read or write
+ */
+static void record_event(shard_t* shard,
+                         int pid,
+                         trace_kind kind,
+                         unsigned long long addr) {
+  trace_record_t record;
+  record.pid = pid;
+  record.kind = kind;
+  record.addr = addr;
+  record.time = get_shard_time(shard);
+  pthread_mutex_lock(&trace_lock);
+  write_trace_record(&trace_writer, &record);
+  pthread_mutex_unlock(&trace_lock);
+}
+
+/**
+ * Runs every reference in a trace through the
+ * memory manager, without any user processes.
+ *
+ * The clock is moved forward to each record's time
+ * if handling earlier records has not already passed it.
+ */
+static void replay_trace() {
+  trace_reader_t reader;
+  if (open_trace_reader(&reader, replay_path) == -1) {
+    free_shm();
+    exit(EXIT_FAILURE);
+  }
+  if (reader.max_procs > geometry.max_procs) {
+    fprintf(stderr,
+            "Trace has %d processes. Run with -n %d or more.\n",
+            reader.max_procs,
+            reader.max_procs);
+    close_trace_reader(&reader);
+    free_shm();
+    exit(EXIT_FAILURE);
+  }
+  if (!matches_trace_geometry(&reader.header)) {
+    close_trace_reader(&reader);
+    free_shm();
+    exit(EXIT_FAILURE);
+  }
+
   int i = 0;
-  do {
-    int index = pid * NUM_FRAMES + i;
-    if (unallocated_frames[index] == 1) {
-      frames_allocated++;
+  for (; i < geometry.max_procs; i++) {
+    stats[i].start_time = get_clock_nanosecs(&clock_shm->clock);
+  }
+
+  for (i = 0; i < num_workers; i++) {
+    if (shards[i].probes) open_probes(shards[i].probes);
+  }
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  trace_record_t record;
+  probe_sample_t probe_start;
+  mem_op_t mem_op;
+  mem_cqe_t cqe;
+  unsigned long long num_records = 0;
+  int result;
+  while ((result = read_trace_record(&reader, &record)) == 1) {
+    num_records++;
+    if (record.time > get_clock_nanosecs(&clock_shm->clock)) {
+      set_clock_nanosecs(&clock_shm->clock, record.time);
     }
-    i++;
-  } while (i < NUM_FRAMES);
+    if (record.kind == TRACE_EXIT) {
+      handle_process_exit(record.pid);
+      continue;
+    }
+    if (children[record.pid] == INIT_VAL) {
+      recycle_proc_slot(record.pid);  // A new process in an exited one's PID
+    }
+    mem_op.addr = record.addr;
+    mem_op.op = record.kind;
+    shard_t* shard = get_shard(record.pid);
+    begin_phase(shard, &probe_start);
+    handle_mem_request(shard, record.pid, &mem_op, &cqe);
+    end_phase(shard, PROBE_MEM_REQUEST, &probe_start);
+    if (should_run_page_replacement(shard)) {
+      begin_phase(shard, &probe_start);
+      run_page_replacement(shard);
+      end_phase(shard, PROBE_REPLACEMENT, &probe_start);
+    }
+    flush_shard_clock(shard);
+  }
+  if (result == -1) {
+    fprintf(stderr, "Trace is corrupt. Stopped replaying early.\n");
+  }
+  close_trace_reader(&reader);
+  for (i = 0; i < num_workers; i++) {
+    if (shards[i].probes) close_probes(shards[i].probes);
+  }
+
+  print_rate("Replayed", "records", num_records, &start);
+
+  // Processes still running when the recording ended
+  for (i = 0; i < geometry.max_procs; i++) {
+    if (stats[i].num_mem_accesses > 0) {
+      handle_process_exit(i);
+    }
+  }
+}
+
+static void setup_mem_rings(mem_rings_t* mem_rings) {
+  init_mem_rings(mem_rings, geometry.max_procs, num_workers, get_sem_spin());
+}
 
-  frames_allocated *= 100;
-  int percentage = frames_allocated / NUM_FRAMES;
+static int get_percentage_of_frames_allocated(shard_t* shard) {
+  int frames_allocated = count_allocated_frames(&shard->frames,
+                                                0,
+                                                shard->num_frames);
+  return (long long) frames_allocated * 100 / shard->num_frames;
+}
+
+static int should_run_page_replacement(shard_t* shard) {
+  int percentage = get_percentage_of_frames_allocated(shard);
   print_percentage_of_frames_allocated(percentage);
 
-  if ((100 - percentage) <= 10) {
+  if (percentage >= REPLACEMENT_THRESHOLD) {
     print_running_page_replacement_messsage();
     return 1;
   } else {
@@ -629,44 +2976,80 @@ static int should_run_page_replacement(int pid) {
 
 static void print_running_page_replacement_messsage() {
   if (verbose) {
-    fprintf(log, "Running page replacement routine...\n");
+    log_ints(log, "Running page replacement routine...\n", 0, 0, 0);
   }
 }
 
 static void print_percentage_of_frames_allocated(int percentage) {
   if (verbose) {
-    fprintf(log,
-          "%%%d of total frames allocated\n\n",
-          percentage);
+    log_ints(log, "%%%d of total frames allocated\n\n", percentage, 0, 0);
   }
 }
 
-static void run_page_replacement(int pid) {
-  int i = 0;
+/**
+ * Evicts pages chosen by a shard's replacement policy
+ * until its frames are back under the threshold.
+ *
+ * @param shard The shard
+ */
+static void run_page_replacement(shard_t* shard) {
   do {
-    page* pg = get_page(page_tables, pid, i);
-    if (pg->valid == 1) {
-      print_marking_frame_for_replacement(pg->num);
-      pg->valid = 0;
-    } else if (pg->num != INIT_VAL && pg->valid == 0) {
-      print_freeing_frame(pg->num);
-      int index = pid * NUM_FRAMES + i;
-      unallocated_frames[index] = 0;
-      reset_page(pg);
-    }
-    i++;
-  } while (i < NUM_FRAMES);
-  if (verbose) fprintf(log, "\n");
+    if (!evict_page(shard)) break;
+  } while (get_percentage_of_frames_allocated(shard) >= REPLACEMENT_THRESHOLD);
+  if (verbose) log_ints(log, "\n", 0, 0, 0);
 }
 
-static void print_marking_frame_for_replacement(int frame) {
-  if (verbose) {
-    fprintf(log, "  Marking frame %d for replacement\n", frame);
+/**
+ * Evicts a page that was read ahead and never used, if there is
+ * one, or else the page a shard's replacement policy chooses,
+ * from whichever of its processes owns it, and frees its frame.
+ * A dirty page is queued to be written back, which only takes
+ * time when the swap device's queue is full.
+ *
+ * @param shard The shard
+ * @return      1 if a page was evicted. 0 if none are resident.
+ */
+static int evict_page(shard_t* shard) {
+  int victim = readaheads != NULL ? take_unused_readahead(shard) : NO_VICTIM;
+  int was_unused = victim != NO_VICTIM;
+  if (!was_unused) {
+    victim = replacement_select_victim(shard->replacement);
+  }
+  if (victim == NO_VICTIM) {
+    return 0;
+  }
+  int frame = shard->first_frame + victim;
+  frame_t* owner = frame_table + frame;
+  print_freeing_frame(frame);
+  stats[owner->pid].num_evictions++;
+  if (was_unused) {
+    // Never referenced, so ARC should not remember it
+    replacement_forget(shard->replacement, victim);
+    stats[owner->pid].num_readaheads_wasted++;
+    observe_readahead_waste(readaheads + owner->pid);
+  } else {
+    replacement_evict(shard->replacement, victim);
+  }
+  page* pg = find_page(page_tables, owner->pid, owner->page_num);
+  if (pg->huge) {
+    demote_huge_page(owner->pid, owner->page_num, pg);
+  }
+  if (pg->dirty) {
+    stats[owner->pid].num_writebacks++;
+    shard->elapsed += swap_write(&shard->swap,
+                                 get_swap_block(owner->pid, owner->page_num),
+                                 get_shard_time(shard));
+  }
+  if (tlbs != NULL) {
+    tlb_invalidate(tlbs[owner->pid], owner->page_num);
   }
+  unload_page(page_tables, owner->pid, owner->page_num, &shard->free_nodes);
+  release_frame(shard, frame);
+  return 1;
 }
 
 static void print_freeing_frame(int frame) {
   if (verbose) {
-    fprintf(log, "  Freeing frame %d\n", frame);
+    log_ints(log, "  Freeing frame %d\n", frame, 0, 0);
   }
 }
\ No newline at end of file
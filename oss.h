@@ -1,49 +1,169 @@
 #ifndef OSS_H_
 #define OSS_H_
 
+#include <signal.h>
+#include <stdio.h>
+#include <time.h>
+#include "lib/eventq.h"
+#include "lib/histogram.h"
 #include "lib/pagetable.h"
+#include "lib/probe.h"
+#include "lib/ring.h"
+#include "lib/stats.h"
+#include "lib/swap.h"
+#include "lib/trace.h"
+
+typedef struct shard_t shard_t;
+typedef struct latency_sample_t latency_sample_t;
+typedef struct latency_summary_t latency_summary_t;
+typedef struct logged_page_t logged_page_t;
 
 static void parse_command_options(int argc, char* argv[]);
 static void print_help_message(char* executable_name);
+static unsigned int parse_size_option(int option, char* arg);
+static unsigned long long parse_number_option(int option,
+                                              char* arg,
+                                              unsigned long long max);
+static void parse_levels_option(char* arg);
+static void parse_tlb_option(char* arg);
+static void parse_swap_option(char* arg);
+static void parse_event_limit_option(char* arg);
 static void setup_data_structures();
-static void setup_unallocated_frames();
 static void open_log_file();
+static void close_log_file();
 static void free_shm_and_abort(int signum);
 static void free_shm();
+static void setup_arena();
 static void setup_interrupt_handler();
 static void setup_interval_timer(int time);
 static void handle_timer_interrupt();
 static void handle_child_termination(int signum);
-static void fork_and_exec_children();
-static void fork_and_exec_child(int pid);
-static void check_for_mem_requests();
-static int has_mem_request(mem_op_t mem_op);
-static void handle_mem_request(int pid, mem_op_t* mem_op);
-static void print_received_memory_request(io_op op, int pid, int page_num);
-static void setup_clock_sem();
-static void setup_mem_sems();
+static void block_signals(sigset_t* old_mask);
+static void start_workers(void* (*work)(void*));
+static void join_workers();
+static void* serve_shard(void* arg);
+static void reap_children();
+static int find_child(pid_t pid);
+static void handle_process_exit(int pid);
+static void recycle_proc_slot(int pid);
+static void start_children();
+static void start_arrivals(struct timespec* start, sigset_t* old_mask);
+static void start_arrival(int pid);
+static unsigned long long get_proc_seed(int pid);
+static void setup_spawning();
+static void spawn_child(int pid);
+static int check_for_mem_requests(shard_t* shard);
+static int has_mem_request(int pid);
+static void drain_mem_requests(shard_t* shard, int pid);
+static void record_latencies(int pid,
+                             latency_sample_t* samples,
+                             int num_samples,
+                             unsigned long long batch_start);
+static void flush_shard_clock(shard_t* shard);
+static inline void begin_phase(shard_t* shard, probe_sample_t* start);
+static inline void end_phase(shard_t* shard, probe_phase phase, probe_sample_t* start);
+static void print_probe_report();
+static void handle_mem_request(shard_t* shard,
+                               int pid,
+                               mem_op_t* mem_op,
+                               mem_cqe_t* cqe);
+static page* lookup_tlbs(int pid, long long page_num);
+static void insert_tlbs(int pid, long long page_num, page* pg);
+static page* handle_page_fault(shard_t* shard, int pid, long long page_num, page* pg);
+static void map_page(shard_t* shard, int pid, long long page_num, page* pg);
+static void read_ahead(shard_t* shard, int pid);
+static void use_readahead_page(shard_t* shard, int pid, long long page_num, page* pg);
+static void add_unused_readahead(shard_t* shard, int frame);
+static int take_unused_readahead(shard_t* shard);
+static long long get_swap_block(int pid, long long page_num);
+static unsigned long long get_shard_time(shard_t* shard);
+static int load_huge_page(shard_t* shard, int pid, long long page_num, page* pg);
+static int get_region_frame(shard_t* shard, page* pg, long long page_num);
+static void promote_if_contiguous(shard_t* shard, int pid, long long page_num, page* pg);
+static void demote_huge_page(int pid, long long page_num, page* pg);
+static void print_received_memory_request(io_op op, int pid, long long page_num);
 static void setup_page_tables();
-static void deallocate_mem_sems();
+static void setup_shards();
+static void setup_tlbs();
+static void setup_readaheads();
+static shard_t* get_shard(int pid);
+static void* allocate(size_t size);
+static unsigned long long get_elapsed_nanosecs(struct timespec* start);
+static void terminate_children();
 static void wait_for_all_children();
-static void setup_mem_ops(mem_op_t* mem_ops);
-static int is_page_in_memory(int pid, int page_num);
-static int is_page_table_full(int pid);
-static int get_next_available_page_table_index(int pid);
-static int find_page(int pid, int frame_number);
+static void start_recording();
+static void record_event(shard_t* shard,
+                         int pid,
+                         trace_kind kind,
+                         unsigned long long addr);
+static void replay_trace();
+static int matches_trace_geometry(const trace_header_t* header);
+static void run_sim_procs();
+static void* simulate_shard(void* arg);
+static void start_sim_proc(shard_t* shard, int pid);
+static int step_sim_proc(int pid);
+static void run_events();
+static unsigned int create_event_proc(int pid);
+static int simulate_reference(event_queue_t* queue, int pid, unsigned long long now);
+static void print_rate(char* verb,
+                       char* noun,
+                       unsigned long long count,
+                       struct timespec* start);
+static void setup_mem_rings(mem_rings_t* mem_rings);
+static int is_memory_full(shard_t* shard);
+static int get_next_available_frame(shard_t* shard,
+                                    int pid,
+                                    long long page_num,
+                                    int hint);
+static void release_frame(shard_t* shard, int frame);
+static int get_page_key(shard_t* shard, int pid, long long page_num);
 static void print_page_table(int pid);
-static int should_run_page_replacement(int pid);
-static void run_page_replacement(int pid);
+static void count_leaf_pages(long long first_page,
+                             page* pages,
+                             int num_pages,
+                             void* arg);
+static void copy_leaf_pages(long long first_page,
+                            page* pages,
+                            int num_pages,
+                            void* arg);
+static void format_page_table(FILE* out, const void* data);
+static void format_page_table_rows(FILE* out,
+                                   const logged_page_t* pages,
+                                   int num_pages);
+static int should_run_page_replacement(shard_t* shard);
+static int get_percentage_of_frames_allocated(shard_t* shard);
+static void run_page_replacement(shard_t* shard);
+static int evict_page(shard_t* shard);
 static void print_running_page_replacement_messsage();
 static void print_percentage_of_frames_allocated(int percentage);
-static void print_marking_frame_for_replacement(int frame);
 static void print_freeing_frame(int frame);
 static void print_time();
 static void print_page_tables();
-static void reset_page(page* pg);
-static void free_memory(int pid);
+static void record_tlb_reach(int pid);
+static void free_memory(shard_t* shard, int pid);
+static void release_leaf_frames(long long first_page,
+                                page* pages,
+                                int num_pages,
+                                void* arg);
 static void print_stats_report(int pid);
-static unsigned int get_avg_mem_access_speed(int mem_accesses, int page_faults);
+static void format_stats_report(FILE* out, const void* data);
+static void print_policy_report();
+static void add_to_totals(stats_totals_t* totals, const stats_t* proc);
+static void format_policy_report(FILE* out, const void* data);
+static double get_avg_mem_access_speed(int mem_accesses,
+                                       int page_faults,
+                                       int tlb_hits,
+                                       unsigned long long fault_nanosecs);
+static void print_swap_stats(FILE* out, const swap_stats_t* swap);
+static void print_readahead_stats(FILE* out,
+                                  unsigned long long num_pages,
+                                  unsigned long long num_used,
+                                  unsigned long long num_wasted);
+static void summarize_latency(histogram_t* hist, latency_summary_t* summary);
+static void print_latency_summary(FILE* out,
+                                  const char* name,
+                                  const latency_summary_t* summary);
 static int get_num_procs_completed();
-static void print_stats_report_separator(int length);
+static void print_stats_report_separator(FILE* out, int length);
 
 #endif
\ No newline at end of file
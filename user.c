@@ -8,40 +8,49 @@
 #include "lib/shm.h"
 
 int main(int argc, char* argv[]) {
-  srand(getpid());
-
   validate_number_of_args(argc);
 
   const int pid = atoi(argv[1]);
-  const int clock_id = atoi(argv[2]);
-  const int clock_sem_id = atoi(argv[3]);
-  const int mem_ops_id = atoi(argv[4]);
-  const int mem_sem_id = atoi(argv[5]);
+  const int arena_fd = atoi(argv[2]);
+  const unsigned long long proc_mem = strtoull(argv[3], NULL, 10);
+  const unsigned int page_size = strtoul(argv[4], NULL, 10);
+  const unsigned long long seed = strtoull(argv[5], NULL, 10);
+
+  workload_config_t config;
+  init_workload_config(&config);
+  if (parse_workload_distribution(&config, argv[6]) == -1 ||
+      parse_workload_ratio(&config, argv[7]) == -1) {
+    fprintf(stderr, "Invalid workload\n");
+    exit(EXIT_FAILURE);
+  }
+
+  arena_t* arena = attach_to_arena(arena_fd);
+  clock_shm_t* clock_shm = get_region(arena, CLOCK_REGION);
+  mem_rings_t* mem_rings = get_region(arena, MEM_RINGS_REGION);
+  mem_ring_t* ring = get_ring(mem_rings, pid);
 
-  my_clock* clock_shm;
-  clock_shm = attach_to_clock_shm(clock_id);
+  workload_t workload;
+  init_workload(&workload, &config, seed, proc_mem, page_size);
 
-  mem_op_t* mem_ops;
-  mem_ops = attach_to_mem_ops(mem_ops_id);
+  update_clock_with_creation_time(clock_shm, &workload);
 
-  update_clock_with_creation_time(clock_shm, clock_sem_id);
+  int num_in_flight = 0;
+  for (;;) {
+    num_in_flight += submit_mem_requests(&workload,
+                                         ring,
+                                         num_in_flight,
+                                         &clock_shm->clock);
 
-  int should_terminate = 0;
-  int num_requests = 0;
-  while (!should_terminate) {
-    if (should_check_whether_to_terminate(num_requests)) {
-      check_should_terminate(&should_terminate);
-    }
+    if (num_in_flight == 0) break;
 
-    make_mem_request(mem_ops, pid);
+    ring_doorbell(&mem_rings->doorbell, pid);
 
-    // Wait until request is granted
-    sem_wait(mem_sem_id);
-    num_requests++;
+    // Wait until oss has handled a batch of requests
+    sem_wait(&ring->sem);
+    num_in_flight -= ring_reap_all(ring);
   }
 
-  detach_from_clock_shm(clock_shm);
-  detach_from_mem_ops(mem_ops);
+  detach_from_arena(arena);
 
   return EXIT_SUCCESS;
 }
@@ -62,73 +71,7 @@ static void validate_number_of_args(int argc) {
   }
 }
 
-static void update_clock_with_creation_time(my_clock* clock_shm,
-                                            const int clock_sem_id) {
-  sem_wait(clock_sem_id);
-    unsigned int creation_time = get_creation_time();
-    update_clock(clock_shm, creation_time);
-  sem_post(clock_sem_id);
-}
-
-/**
- * Simulate the overhead of creating a new process.
- *
- * @return 1 - 500 milliseconds (in nanoseconds)
- */
-static unsigned int get_creation_time() {
-  int rand_num = rand() % 500 + 1;
-  return (unsigned) rand_num * NANOSECS_PER_MILLISEC;
-}
-
-/**
- * Get a memory address to make a request to.
- * 
- * @return A memory address
- */
-static unsigned int get_mem_addr() {
-  return rand() % PROC_MEM;
+static void update_clock_with_creation_time(clock_shm_t* clock_shm,
+                                            workload_t* workload) {
+  update_clock(&clock_shm->clock, get_creation_time(workload));
 }
-
-/**
- * Get wheter the I/O operation
- * is a read or write.
- *
- * Reads are more likely than writes.
- * 
- * @return Read or write.
- */
-static io_op get_read_or_write() {
-  int rand_num = rand() % 3;
-  if (rand_num != 0) {
-    return READ;
-  } else {
-    return WRITE;
-  }
-}
-
-/**
- * Check whether the program should terminate.
- * 
- * @param terminate_flag Set to 1 if should terminate. Else set to 0.
- */
-static void check_should_terminate(int* terminate_flag) {
-  int rand_num = rand() % 2;
-  if (rand_num == 0) {
-    *terminate_flag = 1;
-  } else {
-    *terminate_flag = 0;
-  }
-}
-
-static void make_mem_request(mem_op_t* mem_ops, const int pid) {
-  mem_ops[pid].addr = get_mem_addr();
-  mem_ops[pid].op   = get_read_or_write();
-}
-
-static int should_check_whether_to_terminate(int num_requests) {
-  if (num_requests != 0 && num_requests % 100 == 0) {
-    return 1;
-  } else {
-    return 0;
-  }
-}
\ No newline at end of file